@@ -0,0 +1,170 @@
+#version 310 es
+precision highp float;
+
+// One invocation per instance bucket and mesh: frustum and Hi-Z cull the
+// bucket's copies of the mesh, pick their LOD the same way
+// RPMaterial::DrawVisible does and write their indirect draw command.
+// Culled pairs get an empty command so every pair keeps its slot.
+layout (local_size_x = 64) in;
+
+struct CullMesh {
+    vec4 sphere;
+    vec4 extent;
+    uvec4 lodOffsets;
+    uvec4 lodCounts;
+    vec4 lodErrors;
+    uint nodeIdx;
+    uint numLods;
+    uint pad0;
+    uint pad1;
+};
+
+struct InstanceBucket {
+    mat4 pivot;
+    float spread;
+    float scale;
+    uint firstInstance;
+    uint numInstances;
+};
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint reservedMustBeZero;
+};
+
+layout (std430, binding = 0) readonly buffer uMeshBlock {
+    CullMesh meshes[];
+};
+layout (std430, binding = 1) readonly buffer uNodeBlock {
+    mat4 nodeMatrices[];
+};
+layout (std430, binding = 2) writeonly buffer uCommandBlock {
+    DrawCommand commands[];
+};
+layout (std430, binding = 4) readonly buffer uBucketBlock {
+    InstanceBucket buckets[];
+};
+
+uniform uint uNumMeshes;
+uniform uint uNumBuckets;
+uniform vec4 uFrustumPlanes[6];
+uniform mat4 uModelMatrix;
+uniform float uModelScale;
+uniform vec3 uEyePosition;
+uniform float uProjectionScale;
+uniform float uPixelError;
+uniform bool uUseOcclusion;
+uniform mat4 uOcclusionViewProjection;
+uniform int uOcclusionLevels;
+layout(binding = 1) uniform highp sampler2D uHiZTexture;
+
+float MaxScale(mat4 m) {
+    return max(length(m[0].xyz), max(length(m[1].xyz), length(m[2].xyz)));
+}
+
+bool IsVisible(vec3 center, vec3 extent, float radius) {
+    for (int i = 0; i < 6; i++) {
+        vec4 plane = uFrustumPlanes[i];
+        float reach = radius + dot(abs(plane.xyz), extent);
+        if (dot(plane.xyz, center) + plane.w + reach < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsOccluded(vec3 center, vec3 extent) {
+    vec2 ndcMin = vec2(1.0);
+    vec2 ndcMax = vec2(-1.0);
+    float nearestDepth = 1.0;
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = vec3((i & 1) != 0 ? extent.x : -extent.x,
+                           (i & 2) != 0 ? extent.y : -extent.y,
+                           (i & 4) != 0 ? extent.z : -extent.z);
+        vec4 clip = uOcclusionViewProjection * vec4(center + corner, 1.0);
+        if (clip.w <= 1e-5) {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc.xy);
+        ndcMax = max(ndcMax, ndc.xy);
+        nearestDepth = min(nearestDepth, ndc.z * 0.5 + 0.5);
+    }
+    if (any(lessThan(ndcMax, vec2(-1.0))) ||
+        any(greaterThan(ndcMin, vec2(1.0)))) {
+        return false;
+    }
+    vec2 size = vec2(textureSize(uHiZTexture, 0));
+    ivec2 texelMin = ivec2(clamp((ndcMin * 0.5 + 0.5) * size, vec2(0.0),
+                                 size - 1.0));
+    ivec2 texelMax = ivec2(clamp((ndcMax * 0.5 + 0.5) * size, vec2(0.0),
+                                 size - 1.0));
+    // coarsest level where the box covers at most 2x2 texels
+    int level = 0;
+    while (level + 1 < uOcclusionLevels &&
+           any(greaterThan((texelMax >> level) - (texelMin >> level),
+                           ivec2(1)))) {
+        level++;
+    }
+    ivec2 levelMin = texelMin >> level;
+    ivec2 levelMax = texelMax >> level;
+    float farthestDepth = 0.0;
+    for (int y = levelMin.y; y <= levelMax.y; y++) {
+        for (int x = levelMin.x; x <= levelMax.x; x++) {
+            farthestDepth = max(farthestDepth,
+                                texelFetch(uHiZTexture, ivec2(x, y), level).r);
+        }
+    }
+    return nearestDepth > farthestDepth;
+}
+
+void main() {
+    uint commandIdx = gl_GlobalInvocationID.x;
+    uint bucketIdx = commandIdx / uNumMeshes;
+    if (bucketIdx >= uNumBuckets) {
+        return;
+    }
+    InstanceBucket bucket = buckets[bucketIdx];
+    CullMesh mesh = meshes[commandIdx % uNumMeshes];
+    mat4 nodeMatrix = nodeMatrices[mesh.nodeIdx];
+    float nodeScale = MaxScale(nodeMatrix);
+    vec3 nodeCenter = (nodeMatrix * vec4(mesh.sphere.xyz, 1.0)).xyz;
+    float spread = 0.0;
+    if (bucket.numInstances > 1u) {
+        spread = bucket.spread + 2.0 * bucket.scale * length(nodeCenter);
+    }
+    vec3 center = (uModelMatrix * bucket.pivot * vec4(nodeCenter, 1.0)).xyz;
+    float meshRadius = bucket.scale * nodeScale * mesh.sphere.w;
+    float radius = uModelScale * (meshRadius + spread);
+
+    bool visible = bucket.numInstances > 0u &&
+                   IsVisible(center, vec3(0.0), radius);
+    vec3 boxCenter = center;
+    vec3 boxExtent = vec3(radius);
+    if (visible && bucket.numInstances == 1u) {
+        mat4 boxMatrix = uModelMatrix * bucket.pivot * nodeMatrix;
+        boxCenter = (boxMatrix * vec4(mesh.sphere.xyz, 1.0)).xyz;
+        boxExtent = abs(boxMatrix[0].xyz) * mesh.extent.x +
+                    abs(boxMatrix[1].xyz) * mesh.extent.y +
+                    abs(boxMatrix[2].xyz) * mesh.extent.z;
+        visible = IsVisible(boxCenter, boxExtent, 0.0);
+    }
+    if (visible && uUseOcclusion) {
+        visible = !IsOccluded(boxCenter, boxExtent);
+    }
+
+    float distance = max(length(center - uEyePosition) - radius, 1e-3);
+    float pixelsPerUnit =
+        uModelScale * bucket.scale * nodeScale * uProjectionScale / distance;
+    uint lod = 0u;
+    while (lod + 1u < mesh.numLods &&
+           mesh.lodErrors[lod + 1u] * pixelsPerUnit <= uPixelError) {
+        lod++;
+    }
+    commands[commandIdx] = DrawCommand(visible ? mesh.lodCounts[lod] : 0u,
+                                       visible ? bucket.numInstances : 0u,
+                                       mesh.lodOffsets[lod], 0, 0u);
+}
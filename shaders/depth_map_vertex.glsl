@@ -1,4 +1,4 @@
-#version 300 es
+#version 310 es
 precision highp float;
 
 uniform mat4 uMVP;
@@ -1,52 +1,43 @@
-#version 300 es
+#version 310 es
 precision highp float;
 
-#include "structs.glsl"
+#include "frame.glsl"
 #include "functions.glsl"
 
-//Materials UBO
-#define NUM_MATERIALS 256
-layout(std140) uniform uMaterialBlock {
-  Material materials[NUM_MATERIALS];
+//Materials SSBO, shared by every mesh group and the terrain
+layout(std430, binding = 3) readonly buffer uMaterialBlock {
+  Material materials[];
 } uMaterial;
 
 in vec3 normalDir;
 in vec3 worldPos;
-in vec2 texCoords;
 in vec4 lightSpacePosition;
 flat in uint materialIdx;
 out vec4 FragColor;
 
-uniform sampler2DShadow uDepthTexture;
-
-uniform vec3 uAmbientLightColor;
-uniform vec3 uLightDir;
-uniform vec3 uLightColor;
-uniform vec3 uCameraPos;
-uniform float uSpecularPower;
-uniform float uShininessScale;
+layout(binding = 0) uniform sampler2DShadow uDepthTexture;
 
 void main() {
   Material material = uMaterial.materials[materialIdx];
   vec3 nNormalDir = normalize(normalDir);
-  vec3 lightDir = normalize(uLightDir);
+  vec3 lightDir = normalize(uFrame.lightDir.xyz);
 
   //diffuse lighting
   float diffuseFactor = dot(nNormalDir, lightDir);
   vec3 diffuseColor = max(diffuseFactor, 0.0) *
-                      uLightColor;
+                      uFrame.lightColor.rgb;
 
   //specular lighting
   vec3 reflectDir = normalize(reflect(-lightDir, nNormalDir));
-  vec3 viewDir = normalize(worldPos - uCameraPos);
-  float shininess = material.shininess / uShininessScale;
+  vec3 viewDir = normalize(worldPos - uFrame.cameraPos.xyz);
+  float shininess = material.shininess / uFrame.shininessScale;
   float specularFactor = max(dot(reflectDir, -viewDir), 0.0);
-  specularFactor = pow(specularFactor, uSpecularPower) * shininess;
+  specularFactor = pow(specularFactor, uFrame.specularPower) * shininess;
   
   vec3 materialColor = material.diffuseColor;
-  vec3 ambientColor = uAmbientLightColor * material.ambientColor * materialColor;
+  vec3 ambientColor = uFrame.ambientLightColor.rgb * material.ambientColor * materialColor;
   vec3 litColor = diffuseColor * materialColor +
-                  specularFactor * uLightColor * material.specularColor;
+                  specularFactor * uFrame.lightColor.rgb * material.specularColor;
   if (diffuseFactor > 0.0f) {
     float bias = mix(0.0000001, 0.000001, diffuseFactor);
     float shadowFactor = CalcShadowFactor(uDepthTexture, lightSpacePosition, bias);
@@ -0,0 +1,31 @@
+#include "structs.glsl"
+
+// Written once per frame and shared by every program, see FrameBlock in
+// src/RenderPass.hpp
+layout(std140, binding = 0) uniform uFrameBlock {
+  mat4 viewProjection;
+  mat4 lightViewProjection;
+  vec4 cameraPos;
+  vec4 ambientLightColor;
+  vec4 lightDir;
+  vec4 lightColor;
+  float specularPower;
+  float shininessScale;
+  TileConfig tileConfig;
+} uFrame;
+
+// The object being drawn, see DrawBlock
+layout(std140, binding = 1) uniform uDrawBlock {
+  mat4 modelMatrix;
+  vec4 positionOffset;
+  vec4 positionScale;
+} uDraw;
+
+// Shadow passes render from the light, everything else from the camera
+mat4 GetViewProjection() {
+#ifdef LIGHT_VIEW
+  return uFrame.lightViewProjection;
+#else
+  return uFrame.viewProjection;
+#endif
+}
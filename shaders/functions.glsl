@@ -1,5 +1,13 @@
+// Radius of the PCF kernel in shadow map texels, 0 takes a single sample
+#ifndef SHADOW_PCF_RADIUS
+#define SHADOW_PCF_RADIUS 2
+#endif
+// How much of the light a shadow blocks
+#ifndef SHADOW_STRENGTH
+#define SHADOW_STRENGTH 0.8
+#endif
+
 float CalcShadowFactor(sampler2DShadow shadowMap, vec4 position, float bias) {
-  float kShadowStrength = 0.8;
   vec3 ProjCoords = position.xyz / position.w;
   vec3 UVCoords;
   UVCoords.x = 0.5 * ProjCoords.x + 0.5;
@@ -11,15 +19,14 @@ float CalcShadowFactor(sampler2DShadow shadowMap, vec4 position, float bias) {
   UVCoords.z -= bias;
   float shadowFactor = 0.0;
   float texelSize = 1.0 / float(textureSize(shadowMap, 0));
-  int nNeighbors = 2;
-  float kernelSize = pow(float(nNeighbors) * 2.0 + 1.0, 2.0f);
-  for (int y = -nNeighbors ; y <= nNeighbors ; y++) {
-    for (int x = -nNeighbors ; x <= nNeighbors ; x++) {
+  const float kernelSize = pow(float(SHADOW_PCF_RADIUS) * 2.0 + 1.0, 2.0f);
+  for (int y = -SHADOW_PCF_RADIUS ; y <= SHADOW_PCF_RADIUS ; y++) {
+    for (int x = -SHADOW_PCF_RADIUS ; x <= SHADOW_PCF_RADIUS ; x++) {
       vec3 offset = vec3(float(x) * texelSize,
                           float(y) * texelSize,
                           0.0f);
       shadowFactor += texture(shadowMap, UVCoords + offset);
     }
   }
-  return ((1.0 - kShadowStrength) + (shadowFactor * kShadowStrength) / kernelSize);
+  return ((1.0 - SHADOW_STRENGTH) + (shadowFactor * SHADOW_STRENGTH) / kernelSize);
 }
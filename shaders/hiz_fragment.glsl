@@ -0,0 +1,23 @@
+#version 310 es
+precision highp float;
+
+// Level 0 copies the depth buffer, every other level keeps the farthest of
+// the 2x2 source texels it covers so a test against it is conservative.
+layout(binding = 1) uniform highp sampler2D uSourceTexture;
+uniform bool uCopy;
+
+layout (location = 0) out float FragDepth;
+void main() {
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    if (uCopy) {
+        FragDepth = texelFetch(uSourceTexture, coord, 0).r;
+        return;
+    }
+    // lod counts from the base level, which BuildPyramid sets to the source
+    coord *= 2;
+    float depth = texelFetch(uSourceTexture, coord, 0).r;
+    depth = max(depth, texelFetch(uSourceTexture, coord + ivec2(1, 0), 0).r);
+    depth = max(depth, texelFetch(uSourceTexture, coord + ivec2(0, 1), 0).r);
+    depth = max(depth, texelFetch(uSourceTexture, coord + ivec2(1, 1), 0).r);
+    FragDepth = depth;
+}
@@ -2,7 +2,7 @@ struct TileConfig {
   float height_scale;
   float width_scale;
   float grid_scale;
-  int resolution;
+  highp int resolution;
   float repeat_scale;
   float rotation_scale;
   float translation_scale;
@@ -1,32 +1,35 @@
-#version 300 es
+#version 310 es
 precision highp float;
 
-#include "structs.glsl"
+#include "frame.glsl"
 #include "functions.glsl"
 #include "terrain_functions.glsl"
 
-uniform sampler2DShadow uDepthTexture;
-uniform sampler2D uNoiseTexture;
-uniform sampler2D uHeightmapTexture;
-uniform sampler2DArray uBlendTexture;
+// normalized heights where the blend layers meet
+#ifndef TERRAIN_HIGH_THRESHOLD
+#define TERRAIN_HIGH_THRESHOLD 0.7
+#endif
+#ifndef TERRAIN_MEDIUM_THRESHOLD
+#define TERRAIN_MEDIUM_THRESHOLD 0.3
+#endif
+#ifndef TERRAIN_LOW_THRESHOLD
+#define TERRAIN_LOW_THRESHOLD 0.15
+#endif
+// per-tile hue, saturation and brightness noise
+#ifndef TERRAIN_COLOR_VARIATION
+#define TERRAIN_COLOR_VARIATION 1
+#endif
 
-uniform mat4 uModelMatrix;
-uniform vec3 uAmbientLightColor;
-uniform vec3 uLightDir;
-uniform vec3 uLightColor;
-uniform vec3 uCameraPos;
-uniform float uSpecularPower;
-uniform float uShininessScale;
+layout(binding = 0) uniform sampler2DShadow uDepthTexture;
+layout(binding = 2) uniform sampler2D uNoiseTexture;
+layout(binding = 3) uniform sampler2D uHeightmapTexture;
+layout(binding = 4) uniform sampler2DArray uBlendTexture;
 
-#define NUM_MATERIALS 256
-layout(std140) uniform uMaterialBlock {
-  Material materials[NUM_MATERIALS];
+//Materials SSBO, shared by every mesh group and the terrain
+layout(std430, binding = 3) readonly buffer uMaterialBlock {
+  Material materials[];
 } uMaterial;
 
-layout(std140) uniform uTileConfigBlock {
-  TileConfig tileConfig;
-} uTileConfig;
-
 in vec3 worldPos;
 in vec2 texCoords;
 in vec2 heightmapCoords;
@@ -35,34 +38,34 @@ flat in uint materialIdx;
 out vec4 FragColor;
 
 void main() {
-  TileConfig tc = uTileConfig.tileConfig;
+  TileConfig tc = uFrame.tileConfig;
   Material material = uMaterial.materials[materialIdx];
 
   float coordsScale = tc.height_scale / tc.width_scale / tc.grid_scale;
   vec3 normalDir = GetTexGradient(uHeightmapTexture, heightmapCoords, coordsScale, 0.5f);
-  normalDir = mat3(uModelMatrix) * normalDir;
+  normalDir = mat3(uDraw.modelMatrix) * normalDir;
 
-  vec3 lightDir = normalize(uLightDir);
+  vec3 lightDir = normalize(uFrame.lightDir.xyz);
   vec3 nNormalDir = normalize(normalDir);
 
   //lighting variables
   float diffuseFactor = dot(nNormalDir, lightDir);
   vec3 diffuseColor = max(diffuseFactor, 0.0) *
-                      uLightColor;
+                      uFrame.lightColor.rgb;
   vec3 reflectDir = normalize(reflect(-lightDir, nNormalDir));
-  vec3 viewDir = normalize(worldPos - uCameraPos);
-  float shininess = material.shininess / uShininessScale;
+  vec3 viewDir = normalize(worldPos - uFrame.cameraPos.xyz);
+  float shininess = material.shininess / uFrame.shininessScale;
   float specularFactor = max(dot(reflectDir, -viewDir), 0.0);
-  specularFactor = pow(specularFactor, uSpecularPower) * shininess;
+  specularFactor = pow(specularFactor, uFrame.specularPower) * shininess;
   
   //apply texture scaling/displacement
   vec2 transformedCoords = ApplyTexTileConfig(texCoords, tc, uNoiseTexture);
   vec2 noiseCoords = ScaleToCenter(texCoords, 0.5f);
   vec4 color = vec4(0.0f);
   float normalized_height = worldPos.y / tc.height_scale;
-  float kHighThreshold = 0.7;
-  float kMediumThreshold = 0.3;
-  float kLowThreshold = 0.15;
+  const float kHighThreshold = TERRAIN_HIGH_THRESHOLD;
+  const float kMediumThreshold = TERRAIN_MEDIUM_THRESHOLD;
+  const float kLowThreshold = TERRAIN_LOW_THRESHOLD;
   
   if (normalized_height > kHighThreshold) {
     float frac = (normalized_height - kHighThreshold) / (1.0 - kHighThreshold);
@@ -82,12 +85,14 @@ void main() {
   } else {
     color = texture(uBlendTexture, vec3(transformedCoords, 3.0));
   }
+#if TERRAIN_COLOR_VARIATION
   //apply texture color variation
   color = TransformTexColor(color, texCoords, tc, uNoiseTexture);
+#endif
   //apply lighting
-  vec3 ambientColor = uAmbientLightColor * material.ambientColor * color.xyz;
+  vec3 ambientColor = uFrame.ambientLightColor.rgb * material.ambientColor * color.xyz;
   vec3 litColor = diffuseColor * color.xyz +
-                  specularFactor * uLightColor * material.specularColor;
+                  specularFactor * uFrame.lightColor.rgb * material.specularColor;
   //apply shadows
   if (diffuseFactor > 0.0f) {
     float bias = mix(tc.parallel_bias, tc.flat_bias, diffuseFactor) / tc.grid_scale;
@@ -1,19 +1,14 @@
-#version 300 es
+#version 310 es
 
-#include "structs.glsl"
+#include "frame.glsl"
 #include "terrain_functions.glsl"
 
-uniform sampler2D uHeightmapTexture;
-uniform mat4 uMVP;
-
-layout(std140) uniform uTileConfigBlock {
-  TileConfig tileConfig;
-} uTileConfig;
+layout(binding = 3) uniform sampler2D uHeightmapTexture;
 
 flat out vec4 color;
 void main() {
-  TileConfig tc = uTileConfig.tileConfig;
+  TileConfig tc = uFrame.tileConfig;
   vec3 aPos = GetHeightmapSkirtPosition(tc, uHeightmapTexture, gl_VertexID);
   color = vec4(.1,.6,.1,1);
-  gl_Position = uMVP * vec4(aPos, 1.0);
+  gl_Position = GetViewProjection() * uDraw.modelMatrix * vec4(aPos, 1.0);
 }
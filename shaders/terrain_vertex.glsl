@@ -1,34 +1,35 @@
-#version 300 es
+#version 310 es
 
-#include "structs.glsl"
+#include "frame.glsl"
 #include "terrain_functions.glsl"
 
-uniform sampler2D uHeightmapTexture;
-
-uniform mat4 uMVP;
-uniform mat4 uModelMatrix;
-uniform mat4 uLightMVP;
-
-layout(std140) uniform uTileConfigBlock {
-  TileConfig tileConfig;
-} uTileConfig;
+layout(binding = 3) uniform sampler2D uHeightmapTexture;
 
 layout (location = 0) in uint aMaterialIdx;
 
+// shadow and depth passes only need the position
+#ifndef DEPTH_ONLY
 out vec3 worldPos;
 out vec2 texCoords;
 out vec2 heightmapCoords;
 out vec4 lightSpacePosition;
 flat out uint materialIdx;
+#endif
 
 void main() {
-  TileConfig tc = uTileConfig.tileConfig;
-  texCoords = GetHeightmapTexCoords(tc, gl_VertexID);
-  heightmapCoords = GetHeightmapCoords(tc, texCoords);
-  vec3 aPos = GetHeightmapPosition(tc, uHeightmapTexture, texCoords, heightmapCoords);
-  worldPos = (uModelMatrix * vec4(aPos, 1.0)).xyz;
+  TileConfig tc = uFrame.tileConfig;
+  vec2 vertexTexCoords = GetHeightmapTexCoords(tc, gl_VertexID);
+  vec2 vertexHeightmapCoords = GetHeightmapCoords(tc, vertexTexCoords);
+  vec3 aPos = GetHeightmapPosition(tc, uHeightmapTexture, vertexTexCoords,
+                                   vertexHeightmapCoords);
+  vec4 worldPosition = uDraw.modelMatrix * vec4(aPos, 1.0);
+  gl_Position = GetViewProjection() * worldPosition;
+#ifndef DEPTH_ONLY
+  texCoords = vertexTexCoords;
+  heightmapCoords = vertexHeightmapCoords;
+  worldPos = worldPosition.xyz;
   materialIdx = aMaterialIdx;
-  gl_Position = uMVP * vec4(aPos, 1.0);
-  lightSpacePosition = uLightMVP * vec4(aPos, 1.0);
+  lightSpacePosition = uFrame.lightViewProjection * worldPosition;
+#endif
 }
  
\ No newline at end of file
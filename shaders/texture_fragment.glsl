@@ -1,7 +1,7 @@
-#version 300 es
+#version 310 es
 precision highp float;
 
-uniform sampler2DShadow uTexture;
+layout(binding = 1) uniform sampler2DShadow uTexture;
 
 in vec2 texCoord;
 out vec4 FragColor;
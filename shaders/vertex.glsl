@@ -1,26 +1,32 @@
-#version 300 es
+#version 310 es
 
-uniform mat4 uMVP;
-uniform mat4 uModelMatrix;
-uniform mat4 uLightMVP;
+#include "frame.glsl"
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in uint aMaterialIdx;
+layout (location = 4) in mat4 aInstanceMatrix;
+layout (location = 8) in mat4 aNodeMatrix;
 
+// shadow and depth passes only need the position
+#ifndef DEPTH_ONLY
 out vec3 normalDir;
 out vec3 worldPos;
-out vec2 texCoords;
 out vec4 lightSpacePosition;
 flat out uint materialIdx;
+#endif
 
 void main() {
-    texCoords = aTexCoords;
-    normalDir = mat3(uModelMatrix) * aNormal;
-    worldPos = (uModelMatrix * vec4(aPos, 1.0)).xyz;
+    mat4 instanceNodeMatrix = aInstanceMatrix * aNodeMatrix;
+    vec4 position = instanceNodeMatrix *
+                    vec4(uDraw.positionOffset.xyz +
+                         aPos * uDraw.positionScale.xyz, 1.0);
+    vec4 worldPosition = uDraw.modelMatrix * position;
+    gl_Position = GetViewProjection() * worldPosition;
+#ifndef DEPTH_ONLY
+    normalDir = mat3(uDraw.modelMatrix) * mat3(instanceNodeMatrix) * aNormal;
+    worldPos = worldPosition.xyz;
     materialIdx = aMaterialIdx;
-    gl_Position = uMVP * vec4(aPos, 1.0);
-    lightSpacePosition = uLightMVP * vec4(aPos, 1.0);
+    lightSpacePosition = uFrame.lightViewProjection * worldPosition;
+#endif
 }
- 
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include <assimp/Importer.hpp>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../MeshGroup.hpp"
+#include "../ObjLoader.hpp"
+
+// Compares LoadObj with assimp on OBJ files, parsing alone and through the
+// whole MeshGroup build. Usage: obj_bench [file.obj ...]
+
+static const int kRuns = 5;
+
+// Best of kRuns, in milliseconds
+static double Time(const std::function<void()> &func) {
+  double best_ms = 0.0;
+  for (int run = 0; run < kRuns; run++) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best_ms = run == 0 ? elapsed.count() : std::min(best_ms, elapsed.count());
+  }
+  return best_ms;
+}
+
+int main(int argc, char *args[]) {
+  std::vector<std::string> files{};
+  for (int i = 1; i < argc; i++) {
+    files.push_back(args[i]);
+  }
+  if (files.empty()) {
+    files.push_back("assets/bedroom/bedroom.obj");
+  }
+  for (const std::string &file : files) {
+    double assimp_parse_ms = Time([&]() {
+      Assimp::Importer importer;
+      importer.ReadFile(file, 0);
+    });
+    double obj_parse_ms = Time([&]() {
+      ObjModel model{};
+      LoadObj(file, model);
+    });
+    GLuint assimp_vertices = 0;
+    GLuint assimp_elements = 0;
+    double assimp_import_ms = Time([&]() {
+      MeshGroup mesh_group{Import(file)};
+      assimp_vertices = mesh_group.GetNumVertices();
+      assimp_elements = mesh_group.GetNumElements();
+    });
+    GLuint obj_vertices = 0;
+    GLuint obj_elements = 0;
+    double obj_import_ms = Time([&]() {
+      MeshGroup mesh_group{ImportObj(file)};
+      obj_vertices = mesh_group.GetNumVertices();
+      obj_elements = mesh_group.GetNumElements();
+    });
+    printf("%s\n", file.c_str());
+    printf("  parse   assimp %8.2fms  LoadObj   %8.2fms  x%.1f\n",
+           assimp_parse_ms, obj_parse_ms, assimp_parse_ms / obj_parse_ms);
+    printf("  import  assimp %8.2fms  ImportObj %8.2fms  x%.1f\n",
+           assimp_import_ms, obj_import_ms, assimp_import_ms / obj_import_ms);
+    printf("  vertices %u / %u, elements %u / %u\n", assimp_vertices,
+           obj_vertices, assimp_elements, obj_elements);
+  }
+  return 0;
+}
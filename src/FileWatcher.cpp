@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "FileWatcher.hpp"
+
+static std::string NormalizePath(const std::filesystem::path &path) {
+  return path.lexically_normal().string();
+}
+
+FileWatcher::FileWatcher() {
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0) {
+    std::cerr << "Could not start file watcher, hot reload is off."
+              << std::endl;
+  }
+};
+
+FileWatcher::~FileWatcher() {
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+};
+
+void FileWatcher::Watch(const std::string &path) {
+  if (m_fd < 0) {
+    return;
+  }
+  std::filesystem::path directory = std::filesystem::path(path).parent_path();
+  if (directory.empty()) {
+    directory = ".";
+  }
+  int wd = inotify_add_watch(m_fd, directory.c_str(),
+                             IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  if (wd < 0) {
+    std::cerr << "Could not watch: " << directory << std::endl;
+    return;
+  }
+  m_directories[wd] = directory.string();
+  m_files[NormalizePath(path)] = path;
+};
+
+std::vector<std::string> FileWatcher::Poll() {
+  std::vector<std::string> changed{};
+  if (m_fd < 0) {
+    return changed;
+  }
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    ssize_t size = read(m_fd, buffer, sizeof(buffer));
+    if (size <= 0) {
+      break;
+    }
+    for (ssize_t offset = 0; offset < size;) {
+      const inotify_event *event = (const inotify_event *)(buffer + offset);
+      offset += sizeof(inotify_event) + event->len;
+      auto directory = m_directories.find(event->wd);
+      if (event->len == 0 || directory == m_directories.end()) {
+        continue;
+      }
+      auto file = m_files.find(NormalizePath(
+          std::filesystem::path(directory->second) / event->name));
+      if (file != m_files.end() &&
+          std::find(changed.begin(), changed.end(), file->second) ==
+              changed.end()) {
+        changed.push_back(file->second);
+      }
+    }
+  }
+  return changed;
+};
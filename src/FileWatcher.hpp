@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils.hpp"
+
+// Reports watched files that were written or replaced. Watches their
+// directories with inotify, so files saved by renaming a temporary over
+// them are seen too. Never blocks; poll once per frame.
+class FileWatcher {
+public:
+  FileWatcher();
+  ~FileWatcher();
+  NEVER_COPY(FileWatcher);
+  void Watch(const std::string &path);
+  // Watched files changed since the last call, each once, as passed to
+  // Watch
+  std::vector<std::string> Poll();
+
+private:
+  int m_fd{-1};
+  // inotify watch descriptor -> directory
+  std::unordered_map<int, std::string> m_directories{};
+  // normalized path -> path as passed to Watch
+  std::unordered_map<std::string, std::string> m_files{};
+};
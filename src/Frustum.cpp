@@ -0,0 +1,101 @@
+#include "Frustum.hpp"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+Frustum ExtractFrustum(const glm::mat4 &view_projection) {
+  // Gribb & Hartmann: each clip plane is row 3 plus or minus row 0, 1 or 2
+  const glm::mat4 m = glm::transpose(view_projection);
+  const glm::vec4 planes[6] = {m[3] + m[0], m[3] - m[0], m[3] + m[1],
+                               m[3] - m[1], m[3] + m[2], m[3] - m[2]};
+  Frustum frustum{};
+  for (int i = 0; i < 8; i++) {
+    glm::vec4 plane{0.0f, 0.0f, 0.0f, 1.0f};
+    if (i < 6) {
+      plane = planes[i] / glm::length(glm::vec3(planes[i]));
+    }
+    frustum.normal_x[i] = plane.x;
+    frustum.normal_y[i] = plane.y;
+    frustum.normal_z[i] = plane.z;
+    frustum.distance[i] = plane.w;
+  }
+  return frustum;
+}
+
+#ifdef __SSE__
+// Signed distance of the centre plus how far the volume reaches towards the
+// plane, four planes at a time. Visible if that is non-negative everywhere.
+static bool IsVisible(const Frustum &frustum, const glm::vec3 &center,
+                      const glm::vec3 &extent, float radius) {
+  const __m128 sign_mask = _mm_set1_ps(-0.0f);
+  const __m128 center_x = _mm_set1_ps(center.x);
+  const __m128 center_y = _mm_set1_ps(center.y);
+  const __m128 center_z = _mm_set1_ps(center.z);
+  const __m128 extent_x = _mm_set1_ps(extent.x);
+  const __m128 extent_y = _mm_set1_ps(extent.y);
+  const __m128 extent_z = _mm_set1_ps(extent.z);
+  const __m128 reach_radius = _mm_set1_ps(radius);
+  for (int i = 0; i < 8; i += 4) {
+    __m128 normal_x = _mm_load_ps(&frustum.normal_x[i]);
+    __m128 normal_y = _mm_load_ps(&frustum.normal_y[i]);
+    __m128 normal_z = _mm_load_ps(&frustum.normal_z[i]);
+    __m128 distance = _mm_load_ps(&frustum.distance[i]);
+    distance = _mm_add_ps(distance, _mm_mul_ps(normal_x, center_x));
+    distance = _mm_add_ps(distance, _mm_mul_ps(normal_y, center_y));
+    distance = _mm_add_ps(distance, _mm_mul_ps(normal_z, center_z));
+    __m128 reach = reach_radius;
+    reach = _mm_add_ps(
+        reach, _mm_mul_ps(_mm_andnot_ps(sign_mask, normal_x), extent_x));
+    reach = _mm_add_ps(
+        reach, _mm_mul_ps(_mm_andnot_ps(sign_mask, normal_y), extent_y));
+    reach = _mm_add_ps(
+        reach, _mm_mul_ps(_mm_andnot_ps(sign_mask, normal_z), extent_z));
+    __m128 outside =
+        _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps());
+    if (_mm_movemask_ps(outside) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+#else
+static bool IsVisible(const Frustum &frustum, const glm::vec3 &center,
+                      const glm::vec3 &extent, float radius) {
+  for (int i = 0; i < 8; i++) {
+    glm::vec3 normal{frustum.normal_x[i], frustum.normal_y[i],
+                     frustum.normal_z[i]};
+    float reach = radius + glm::dot(glm::abs(normal), extent);
+    if (glm::dot(normal, center) + frustum.distance[i] + reach < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+#endif
+
+bool IsSphereVisible(const Frustum &frustum, const glm::vec3 &center,
+                     float radius) {
+  return IsVisible(frustum, center, glm::vec3{0.0f}, radius);
+}
+
+bool IsBoxVisible(const Frustum &frustum, const glm::vec3 &center,
+                  const glm::vec3 &extent) {
+  return IsVisible(frustum, center, extent, 0.0f);
+}
+
+void TransformBox(const glm::mat4 &transform, const glm::vec3 &center,
+                  const glm::vec3 &extent, glm::vec3 &out_center,
+                  glm::vec3 &out_extent) {
+  out_center = glm::vec3(transform * glm::vec4(center, 1.0f));
+  out_extent = glm::vec3{0.0f};
+  for (int i = 0; i < 3; i++) {
+    out_extent += glm::abs(glm::vec3(transform[i])) * extent[i];
+  }
+}
+
+float MaxScale(const glm::mat4 &transform) {
+  return glm::max(glm::length(glm::vec3(transform[0])),
+                  glm::max(glm::length(glm::vec3(transform[1])),
+                           glm::length(glm::vec3(transform[2]))));
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// The six clip planes of a view-projection matrix, normalized and stored
+// structure-of-arrays so four planes are tested per SIMD instruction. The
+// last two slots hold planes every volume passes.
+struct Frustum {
+  alignas(16) float normal_x[8];
+  alignas(16) float normal_y[8];
+  alignas(16) float normal_z[8];
+  alignas(16) float distance[8];
+};
+
+// Planes are in the space view_projection transforms from, so extracting
+// from projection * view gives world-space planes.
+Frustum ExtractFrustum(const glm::mat4 &view_projection);
+// Conservative: true unless the volume is fully outside one plane.
+bool IsSphereVisible(const Frustum &frustum, const glm::vec3 &center,
+                     float radius);
+bool IsBoxVisible(const Frustum &frustum, const glm::vec3 &center,
+                  const glm::vec3 &extent);
+// Axis aligned box around a transformed box (Arvo 1990).
+void TransformBox(const glm::mat4 &transform, const glm::vec3 &center,
+                  const glm::vec3 &extent, glm::vec3 &out_center,
+                  glm::vec3 &out_extent);
+// Largest axis scale of transform, bounds a transformed sphere's radius.
+float MaxScale(const glm::mat4 &transform);
@@ -0,0 +1,312 @@
+#include "GLState.hpp"
+#include <iterator>
+
+static const GLenum kBufferTargets[] = {
+    GL_ARRAY_BUFFER,          GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+    GL_SHADER_STORAGE_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+    GL_DISPATCH_INDIRECT_BUFFER, GL_PIXEL_PACK_BUFFER,
+    GL_PIXEL_UNPACK_BUFFER,   GL_COPY_READ_BUFFER,     GL_COPY_WRITE_BUFFER};
+// targets that also have indexed binding points
+static const GLenum kIndexedTargets[] = {GL_UNIFORM_BUFFER,
+                                         GL_SHADER_STORAGE_BUFFER};
+static const GLenum kTextureTargets[] = {GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY,
+                                         GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP};
+static const GLenum kCaps[] = {GL_DEPTH_TEST,         GL_CULL_FACE,
+                               GL_BLEND,              GL_SCISSOR_TEST,
+                               GL_STENCIL_TEST,       GL_POLYGON_OFFSET_FILL,
+                               GL_RASTERIZER_DISCARD};
+static_assert(std::size(kBufferTargets) == GLState::kNumBufferTargets);
+static_assert(std::size(kIndexedTargets) == GLState::kNumIndexedTargets);
+static_assert(std::size(kTextureTargets) == GLState::kNumTextureTargets);
+static_assert(std::size(kCaps) == GLState::kNumCaps);
+
+// Position of value in table, or -1 if it is not cached
+template <size_t N>
+static int FindTarget(const GLenum (&table)[N], GLenum value) {
+  for (size_t i = 0; i < N; i++) {
+    if (table[i] == value) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+GLState &GetGLState() {
+  static GLState state{};
+  return state;
+};
+
+bool GLState::Update(GLuint &cached, GLuint value) {
+  if (cached == value) {
+    m_num_avoided++;
+    return false;
+  }
+  cached = value;
+  m_num_issued++;
+  return true;
+};
+
+void GLState::UseProgram(GLuint program) {
+  if (Update(m_program, program)) {
+    glUseProgram(program);
+  }
+};
+
+GLuint GLState::GetProgram() {
+  if (m_program == kUnknown) {
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    m_program = program;
+    m_num_issued++;
+  } else {
+    m_num_avoided++;
+  }
+  return m_program;
+};
+
+void GLState::BindVertexArray(GLuint vao) {
+  if (Update(m_vao, vao)) {
+    glBindVertexArray(vao);
+    m_buffers[FindTarget(kBufferTargets, GL_ELEMENT_ARRAY_BUFFER)] = kUnknown;
+  }
+};
+
+void GLState::BindFramebuffer(GLenum target, GLuint fbo) {
+  bool draw = target != GL_READ_FRAMEBUFFER;
+  bool read = target != GL_DRAW_FRAMEBUFFER;
+  if ((!draw || m_draw_framebuffer == fbo) &&
+      (!read || m_read_framebuffer == fbo)) {
+    m_num_avoided++;
+    return;
+  }
+  if (draw) {
+    m_draw_framebuffer = fbo;
+  }
+  if (read) {
+    m_read_framebuffer = fbo;
+  }
+  m_num_issued++;
+  glBindFramebuffer(target, fbo);
+};
+
+void GLState::BindBuffer(GLenum target, GLuint buffer) {
+  int t = FindTarget(kBufferTargets, target);
+  if (t < 0) {
+    m_num_issued++;
+    glBindBuffer(target, buffer);
+  } else if (Update(m_buffers[t], buffer)) {
+    glBindBuffer(target, buffer);
+  }
+};
+
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+  BindBufferRange(target, index, buffer, 0, 0);
+};
+
+void GLState::BindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                              GLintptr offset, GLsizeiptr size) {
+  int t = FindTarget(kIndexedTargets, target);
+  IndexedBinding binding{.buffer = buffer, .offset = offset, .size = size};
+  if (t >= 0 && index < kMaxBufferIndices) {
+    IndexedBinding &cached = m_indexed[t][index];
+    if (cached.buffer == buffer && cached.offset == offset &&
+        cached.size == size) {
+      m_num_avoided++;
+      return;
+    }
+    cached = binding;
+  }
+  m_num_issued++;
+  if (size == 0) {
+    glBindBufferBase(target, index, buffer);
+  } else {
+    glBindBufferRange(target, index, buffer, offset, size);
+  }
+  t = FindTarget(kBufferTargets, target);
+  if (t >= 0) {
+    m_buffers[t] = buffer;
+  }
+};
+
+void GLState::ActiveTexture(GLenum texture) {
+  if (Update(m_active_texture, texture)) {
+    glActiveTexture(texture);
+  }
+};
+
+void GLState::BindTexture(GLenum target, GLuint texture) {
+  GLuint unit = m_active_texture - GL_TEXTURE0;
+  int t = FindTarget(kTextureTargets, target);
+  if (m_active_texture == kUnknown || unit >= kMaxTextureUnits || t < 0) {
+    m_num_issued++;
+    glBindTexture(target, texture);
+  } else if (Update(m_textures[unit][t], texture)) {
+    glBindTexture(target, texture);
+  }
+};
+
+void GLState::SetEnabled(GLenum cap, bool enabled) {
+  int c = FindTarget(kCaps, cap);
+  if (c < 0) {
+    m_num_issued++;
+  } else if (!Update(m_caps[c], enabled ? GL_TRUE : GL_FALSE)) {
+    return;
+  }
+  if (enabled) {
+    glEnable(cap);
+  } else {
+    glDisable(cap);
+  }
+};
+
+bool GLState::IsEnabled(GLenum cap) {
+  int c = FindTarget(kCaps, cap);
+  if (c >= 0 && m_caps[c] != kUnknown) {
+    m_num_avoided++;
+    return m_caps[c] == GL_TRUE;
+  }
+  m_num_issued++;
+  GLboolean enabled = glIsEnabled(cap);
+  if (c >= 0) {
+    m_caps[c] = enabled;
+  }
+  return enabled == GL_TRUE;
+};
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  glm::ivec4 viewport{x, y, width, height};
+  if (m_has_viewport && m_viewport == viewport) {
+    m_num_avoided++;
+    return;
+  }
+  m_has_viewport = true;
+  m_viewport = viewport;
+  m_num_issued++;
+  glViewport(x, y, width, height);
+};
+
+glm::ivec4 GLState::GetViewport() {
+  if (!m_has_viewport) {
+    glGetIntegerv(GL_VIEWPORT, &m_viewport[0]);
+    m_has_viewport = true;
+    m_num_issued++;
+  } else {
+    m_num_avoided++;
+  }
+  return m_viewport;
+};
+
+void GLState::CullFace(GLenum mode) {
+  if (Update(m_cull_face, mode)) {
+    glCullFace(mode);
+  }
+};
+
+GLenum GLState::GetCullFace() {
+  if (m_cull_face == kUnknown) {
+    GLint mode = 0;
+    glGetIntegerv(GL_CULL_FACE_MODE, &mode);
+    m_cull_face = mode;
+    m_num_issued++;
+  } else {
+    m_num_avoided++;
+  }
+  return m_cull_face;
+};
+
+void GLState::FrontFace(GLenum mode) {
+  if (Update(m_front_face, mode)) {
+    glFrontFace(mode);
+  }
+};
+
+GLenum GLState::GetFrontFace() {
+  if (m_front_face == kUnknown) {
+    GLint mode = 0;
+    glGetIntegerv(GL_FRONT_FACE, &mode);
+    m_front_face = mode;
+    m_num_issued++;
+  } else {
+    m_num_avoided++;
+  }
+  return m_front_face;
+};
+
+void GLState::DeleteBuffer(GLuint buffer) {
+  glDeleteBuffers(1, &buffer);
+  for (GLuint &cached : m_buffers) {
+    if (cached == buffer) {
+      cached = 0;
+    }
+  }
+  for (auto &bindings : m_indexed) {
+    for (IndexedBinding &binding : bindings) {
+      if (binding.buffer == buffer) {
+        binding.buffer = kUnknown;
+      }
+    }
+  }
+};
+
+void GLState::DeleteVertexArray(GLuint vao) {
+  glDeleteVertexArrays(1, &vao);
+  if (m_vao == vao) {
+    m_vao = 0;
+    m_buffers[FindTarget(kBufferTargets, GL_ELEMENT_ARRAY_BUFFER)] = kUnknown;
+  }
+};
+
+void GLState::DeleteTexture(GLuint texture) {
+  glDeleteTextures(1, &texture);
+  for (auto &unit : m_textures) {
+    for (GLuint &cached : unit) {
+      if (cached == texture) {
+        cached = 0;
+      }
+    }
+  }
+};
+
+void GLState::DeleteFramebuffer(GLuint fbo) {
+  glDeleteFramebuffers(1, &fbo);
+  if (m_draw_framebuffer == fbo) {
+    m_draw_framebuffer = 0;
+  }
+  if (m_read_framebuffer == fbo) {
+    m_read_framebuffer = 0;
+  }
+};
+
+void GLState::Invalidate() {
+  m_program = kUnknown;
+  m_vao = kUnknown;
+  m_draw_framebuffer = kUnknown;
+  m_read_framebuffer = kUnknown;
+  for (GLuint &buffer : m_buffers) {
+    buffer = kUnknown;
+  }
+  for (auto &bindings : m_indexed) {
+    for (IndexedBinding &binding : bindings) {
+      binding = {.buffer = kUnknown, .offset = 0, .size = 0};
+    }
+  }
+  m_active_texture = kUnknown;
+  for (auto &unit : m_textures) {
+    for (GLuint &texture : unit) {
+      texture = kUnknown;
+    }
+  }
+  for (GLuint &cap : m_caps) {
+    cap = kUnknown;
+  }
+  m_has_viewport = false;
+  m_cull_face = kUnknown;
+  m_front_face = kUnknown;
+};
+
+void GLState::BeginFrame() {
+  m_last_avoided = m_num_avoided;
+  m_last_issued = m_num_issued;
+  m_num_avoided = 0;
+  m_num_issued = 0;
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include "gl.hpp"
+#include "utils.hpp"
+#include <glm/glm.hpp>
+
+// CPU copy of the GL state the render passes change. Calls that would set
+// what is already current are skipped, and queries are answered from the
+// copy instead of a glGet that may stall the driver. State starts out
+// unknown and is read back once the first time it is queried.
+// Everything that changes this state has to go through GetGLState(); code
+// that calls GL directly, like the ImGui backend, must be followed by
+// Invalidate().
+class GLState {
+public:
+  // units and binding points above these are passed through uncached
+  static const GLuint kMaxTextureUnits = 8;
+  static const GLuint kMaxBufferIndices = 8;
+  // sizes of the tables of cached targets in GLState.cpp
+  static const GLuint kNumBufferTargets = 10;
+  static const GLuint kNumIndexedTargets = 2;
+  static const GLuint kNumTextureTargets = 4;
+  static const GLuint kNumCaps = 7;
+  GLState() { Invalidate(); };
+  NEVER_COPY(GLState);
+
+  void UseProgram(GLuint program);
+  GLuint GetProgram();
+  // The element array binding belongs to the vertex array, it is unknown
+  // again after this
+  void BindVertexArray(GLuint vao);
+  // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+  void BindFramebuffer(GLenum target, GLuint fbo);
+  void BindBuffer(GLenum target, GLuint buffer);
+  // also bind buffer to target, like GL does
+  void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+  void BindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                       GLintptr offset, GLsizeiptr size);
+  void ActiveTexture(GLenum texture);
+  // to the active texture unit
+  void BindTexture(GLenum target, GLuint texture);
+  void Enable(GLenum cap) { SetEnabled(cap, true); };
+  void Disable(GLenum cap) { SetEnabled(cap, false); };
+  void SetEnabled(GLenum cap, bool enabled);
+  bool IsEnabled(GLenum cap);
+  void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+  glm::ivec4 GetViewport();
+  void CullFace(GLenum mode);
+  GLenum GetCullFace();
+  void FrontFace(GLenum mode);
+  GLenum GetFrontFace();
+
+  // Deleting an object unbinds it everywhere, and GL may hand its name out
+  // again, so the copy has to forget it too
+  void DeleteBuffer(GLuint buffer);
+  void DeleteVertexArray(GLuint vao);
+  void DeleteTexture(GLuint texture);
+  void DeleteFramebuffer(GLuint fbo);
+
+  // Forgets everything, after GL was called directly
+  void Invalidate();
+  // Starts counting calls for a new frame
+  void BeginFrame();
+  // Calls and queries of the last full frame that were skipped or reached
+  // GL
+  GLuint GetNumAvoided() const { return m_last_avoided; };
+  GLuint GetNumIssued() const { return m_last_issued; };
+
+private:
+  static const GLuint kUnknown = 0xffffffff;
+  struct IndexedBinding {
+    GLuint buffer;
+    GLintptr offset;
+    // 0 for glBindBufferBase
+    GLsizeiptr size;
+  };
+  // Counts a call that is skipped if cached == value, otherwise stores
+  // value and returns true so the caller issues it
+  bool Update(GLuint &cached, GLuint value);
+
+  GLuint m_program;
+  GLuint m_vao;
+  GLuint m_draw_framebuffer;
+  GLuint m_read_framebuffer;
+  GLuint m_buffers[kNumBufferTargets];
+  IndexedBinding m_indexed[kNumIndexedTargets][kMaxBufferIndices];
+  // as GL_TEXTURE0 + unit
+  GLuint m_active_texture;
+  GLuint m_textures[kMaxTextureUnits][kNumTextureTargets];
+  // GL_TRUE, GL_FALSE or kUnknown
+  GLuint m_caps[kNumCaps];
+  bool m_has_viewport;
+  glm::ivec4 m_viewport;
+  GLuint m_cull_face;
+  GLuint m_front_face;
+
+  GLuint m_num_avoided{0};
+  GLuint m_num_issued{0};
+  GLuint m_last_avoided{0};
+  GLuint m_last_issued{0};
+};
+
+// The state of the one GL context
+GLState &GetGLState();
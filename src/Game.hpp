@@ -1,7 +1,9 @@
 #pragma once
 
-#include "MeshGroup.hpp"
+#include "MeshCache.hpp"
+#include "ModelLoader.hpp"
 #include "RenderPass.hpp"
+#include "TransformHierarchy.hpp"
 #include <SDL.h>
 
 struct GameTimer {
@@ -17,6 +19,21 @@ struct GameTimer {
   Uint64 gpu_us{0};
 };
 
+struct RenderStats {
+  DrawStats shadow{};
+  DrawStats material{};
+  GLuint transform_updates{0};
+  GLuint models_loading{0};
+  GLuint stream_stalls{0};
+  // state changes and queries of the last frame, see GLState
+  GLuint gl_state_calls{0};
+  GLuint gl_state_calls_avoided{0};
+  // passes of the render graph run and culled, and its render targets
+  GLuint graph_passes{0};
+  GLuint graph_culled{0};
+  GLuint graph_targets{0};
+};
+
 class Platform;
 class Game {
 public:
@@ -32,14 +49,38 @@ private:
   glm::mat4 m_model_matrix;
   glm::mat4 m_terrain_matrix;
   TextureTileConfig m_tile_config;
-  std::vector<MeshGroup> m_mesh_groups{};
-  std::vector<RPMaterial> m_rp_material{};
+  ModelLoader m_model_loader{};
+  ModelHandle m_model{0};
+  MaterialTable m_material_table{};
+  // m_material_table on the GPU, indexed by vertex material indices.
+  // Re-uploaded whenever a loaded model adds materials.
+  std::vector<SSBO> m_materials_buffer{};
+  GLuint m_num_uploaded_materials{0};
+  // outlives every pass below, they hold its programs
+  ShaderLibrary m_shader_library{};
+  // per-frame data of every pass, see RPStreamBuffer
+  std::vector<RPStreamBuffer> m_stream_buffer{};
+  std::vector<RPFrame> m_rp_frame{};
   std::vector<RPDepthMap> m_rp_depth_map{};
+  std::vector<RPHiZ> m_rp_hiz{};
   std::vector<RPTex> m_rp_tex{};
   std::vector<RPIcon> m_rp_icon{};
   std::vector<RPTerrain> m_rp_terrain{};
   std::vector<RPMaterialShader> m_material_shader{};
+  std::vector<RPCullShader> m_cull_shader{};
   std::vector<RPTerrainShader> m_terrain_shader{};
   std::vector<RPTexture> m_textures{};
+  // declared again every frame, keeps its render targets between frames
+  RenderGraph m_render_graph{};
   GameTimer m_game_timer{};
+  RenderStats m_render_stats{};
+  float m_lod_pixel_error{1.0f};
+  // side length of the grid of model copies drawn with instancing
+  int m_instance_grid{1};
+  // cull and pick LODs in a compute pass and draw indirectly
+  bool m_gpu_culling{false};
+  // ShaderQuality of the lit passes
+  int m_shader_quality{SQ_HIGH};
+  // draw the shadow map over the frame
+  bool m_show_shadow_map{false};
 };
\ No newline at end of file
@@ -7,7 +7,7 @@
 #include <stb_image.h>
 
 #include "../Game.hpp"
-#include "../MeshGroup.hpp"
+#include "../MeshCache.hpp"
 #include "../Platform.hpp"
 #include "../RenderPass.hpp"
 #include "../utils.hpp"
@@ -18,7 +18,7 @@
 static void HandleResize(const SDL_Event *event, Camera &camera) {
   int x = event->window.data1;
   int y = event->window.data2;
-  glViewport(0, 0, x, y);
+  GetGLState().Viewport(0, 0, x, y);
   camera.aspect_ratio = 1.0f * x / y;
 }
 
@@ -111,7 +111,7 @@ RPTexture LoadTexture2DArray(const std::vector<std::string> &paths) {
     stbi_image_free(data);
   }
   glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
-  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  GetGLState().BindTexture(GL_TEXTURE_2D_ARRAY, 0);
   return texture;
 }
 
@@ -405,8 +405,29 @@ RPTexture DisplacementTexture(int texture_size) {
                           GenerateMidpointDisplacementHeightMap(texture_size));
 }
 
-void RenderGui(const GameTimer &game_timer, Camera &camera, Light &light,
-               TextureTileConfig &tileConfig, glm::mat4 &model_matrix) {
+// grid_size x grid_size copies of a model, spaced by its extent on the
+// ground plane, with the first copy left at the model origin
+std::vector<glm::mat4> InstanceGrid(int grid_size, const VertexDecode &decode) {
+  const float kSpacing = 1.1f;
+  std::vector<glm::mat4> transforms{};
+  transforms.reserve(grid_size * grid_size);
+  for (int z = 0; z < grid_size; z++) {
+    for (int x = 0; x < grid_size; x++) {
+      glm::vec3 translation{x * decode.scale.x * kSpacing, 0.0f,
+                            z * decode.scale.z * kSpacing};
+      transforms.push_back(glm::translate(glm::mat4(1.0f), translation));
+    }
+  }
+  return transforms;
+}
+
+void RenderGui(const GameTimer &game_timer, const RenderStats &render_stats,
+               Camera &camera, Light &light, TextureTileConfig &tileConfig,
+               glm::mat4 &model_matrix, float &lod_pixel_error,
+               int &instance_grid, bool &gpu_culling, int &shader_quality,
+               bool &show_shadow_map) {
+  static const char *const kShaderQualityNames[SQ_COUNT] = {"low", "medium",
+                                                            "high"};
 
   ImGuiIO &io = ImGui::GetIO();
   ImGui::Begin("Performance Counters");
@@ -414,6 +435,24 @@ void RenderGui(const GameTimer &game_timer, Camera &camera, Light &light,
   ImGui::Text("cpu=%luus", game_timer.cpu_us);
   ImGui::Text("gui=%luus", game_timer.gui_us);
   ImGui::Text("gpu=%luus", game_timer.gpu_us);
+  ImGui::Text("shadow meshes=%u draws=%u tris=%u", render_stats.shadow.meshes,
+              render_stats.shadow.draw_calls, render_stats.shadow.triangles);
+  ImGui::Text("material meshes=%u draws=%u tris=%u",
+              render_stats.material.meshes, render_stats.material.draw_calls,
+              render_stats.material.triangles);
+  ImGui::Text("transform updates=%u", render_stats.transform_updates);
+  ImGui::Text("models loading=%u", render_stats.models_loading);
+  ImGui::Text("stream stalls=%u", render_stats.stream_stalls);
+  ImGui::Text("gl state calls=%u avoided=%u", render_stats.gl_state_calls,
+              render_stats.gl_state_calls_avoided);
+  ImGui::Text("graph passes=%u culled=%u targets=%u", render_stats.graph_passes,
+              render_stats.graph_culled, render_stats.graph_targets);
+  ImGui::SliderFloat("lod.pixel_error", &lod_pixel_error, 0.0f, 16.0f);
+  ImGui::SliderInt("model.instance_grid", &instance_grid, 1, 64);
+  ImGui::Checkbox("cull.gpu", &gpu_culling);
+  ImGui::Combo("shader.quality", &shader_quality, kShaderQualityNames,
+               SQ_COUNT);
+  ImGui::Checkbox("debug.shadow_map", &show_shadow_map);
   ImGui::DragFloat4("camera.transform[3]", &camera.transform[3][0], .01f, -5.0f,
                     5.0f);
   ImGui::DragFloat4("uModelMatrix[3]", &model_matrix[3][0], .01f, -5.0f, 5.0f);
@@ -459,6 +498,13 @@ void RenderGui(const GameTimer &game_timer, Camera &camera, Light &light,
 }
 
 int kDepthMapSize = 1024;
+// RPStreamBuffer bytes per frame
+GLsizeiptr kStreamFrameBytes = 64 << 10;
+// draw blocks of RPFrame
+const GLuint kDrawModel = 0;
+const GLuint kDrawTerrain = 1;
+// buffer data streamed to the GPU per frame while models load
+GLsizeiptr kModelUploadBytes = 2 << 20;
 int kHeightMapSize = 256;
 int kNoiseTextureSize = 256;
 
@@ -472,6 +518,14 @@ void RegenerateTerrain(RPTexture &tex) {
 }
 
 Game::Game(Platform *platform) : m_platform{platform} {
+  // programs are only submitted here; the driver compiles them while the
+  // textures below load
+  m_rp_hiz.emplace_back(m_shader_library);
+  m_rp_tex.emplace_back(m_shader_library);
+  m_rp_icon.emplace_back(m_shader_library);
+  m_material_shader.emplace_back(m_shader_library);
+  m_cull_shader.emplace_back(m_shader_library);
+  m_terrain_shader.emplace_back(m_shader_library);
   // m_textures.emplace_back(
   // loadTexture2D("assets/textures/eight_square_test/eight_square_test.png"));
   m_textures.emplace_back(
@@ -487,16 +541,13 @@ Game::Game(Platform *platform) : m_platform{platform} {
       "assets/textures/medium/forest_ground_04_diff_4k.jpg",
       "assets/textures/low/rocky_trail_diff_4k.jpg",
   }));
-  m_mesh_groups.emplace_back(Import("assets/fullroom/fullroom.obj"));
-  m_rp_material.emplace_back(m_mesh_groups[0].GetMaterials(),
-                             m_mesh_groups[0].GetVertexBuffer(),
-                             m_mesh_groups[0].GetElementBuffer());
+  // drawn once it has streamed in, the terrain renders meanwhile
+  m_model = m_model_loader.Load("assets/fullroom/fullroom.obj");
   m_rp_depth_map.emplace_back(kDepthMapSize);
-  m_rp_tex.emplace_back();
-  m_rp_icon.emplace_back();
-  m_rp_terrain.emplace_back();
-  m_material_shader.emplace_back();
-  m_terrain_shader.emplace_back();
+  m_stream_buffer.emplace_back(kStreamFrameBytes);
+  m_rp_frame.emplace_back();
+  m_rp_terrain.emplace_back(m_material_table);
+  m_materials_buffer.emplace_back();
   float kGridScale = 200.0f;
   m_light = {
       .ambient_color = {0.5f, 0.5f, 0.5f},
@@ -645,19 +696,56 @@ void HandleInput(Camera &camera) {
   }
 }
 void Game::Render() {
+  GetGLState().BeginFrame();
+  m_render_stats.gl_state_calls = GetGLState().GetNumIssued();
+  m_render_stats.gl_state_calls_avoided = GetGLState().GetNumAvoided();
   HandleInput(m_camera);
+  m_shader_library.Update();
+  m_stream_buffer[0].BeginFrame();
+  m_render_stats.stream_stalls = m_stream_buffer[0].GetNumStalls();
+  m_material_shader[0].SetQuality((ShaderQuality)m_shader_quality);
+  m_terrain_shader[0].SetQuality((ShaderQuality)m_shader_quality);
+  m_model_loader.Update(m_material_table, kModelUploadBytes);
+  m_render_stats.models_loading = m_model_loader.GetNumLoading();
+  const std::vector<BSDFMaterial> &materials{m_material_table.GetMaterials()};
+  if (materials.size() != m_num_uploaded_materials) {
+    m_materials_buffer[0].BufferData(materials.size() * sizeof(materials[0]),
+                                     materials.data(), GL_STATIC_DRAW);
+    m_num_uploaded_materials = materials.size();
+    std::cout << "Material table: " << materials.size() << " materials"
+              << std::endl;
+  }
+  Model *model = m_model_loader.Get(m_model);
+  m_render_stats.transform_updates = 0;
+  if (model != nullptr) {
+    GLuint num_instances = m_instance_grid * m_instance_grid;
+    if (model->rp_material.GetNumInstances() != num_instances) {
+      std::vector<glm::mat4> transforms{InstanceGrid(
+          m_instance_grid, model->rp_material.GetVertexDecode())};
+      model->rp_material.SetInstances(transforms.data(), transforms.size());
+    }
+    m_render_stats.transform_updates = model->transforms.Update();
+    if (m_render_stats.transform_updates > 0) {
+      model->rp_material.SetNodeMatrices(
+          model->transforms.GetWorldMatrices());
+    }
+  }
+  auto DrawModel = [&](const PassView &view) {
+    const std::vector<glm::mat4> &node_matrices{
+        model->transforms.GetWorldMatrices()};
+    if (m_gpu_culling) {
+      return model->rp_material.DrawIndirect(m_cull_shader[0], view,
+                                             node_matrices);
+    }
+    return model->rp_material.DrawVisible(view, node_matrices);
+  };
   m_game_timer.t_finish_events = SDL_GetPerformanceCounter();
-  glClear(GL_DEPTH_BUFFER_BIT);
-  static const float bg[] = {0.2f, 0.2f, 0.2f, 1.0f};
-  glClearBufferfv(GL_COLOR, 0, bg);
 
   glm::vec3 camera_position{GetCameraPos(m_camera.transform)};
   glm::mat4 camera_projection =
       glm::perspective(glm::radians(m_camera.fov), m_camera.aspect_ratio,
                        m_camera.near, m_camera.far);
   glm::mat4 vp = camera_projection * m_camera.transform;
-  glm::mat4 model_vp = vp * m_model_matrix;
-  glm::mat4 terrain_vp = vp * m_terrain_matrix;
 
   glm::vec3 static_light_pos{glm::normalize(m_light.direction) *
                              m_light.static_distance};
@@ -667,67 +755,213 @@ void Game::Render() {
   glm::mat4 light_projection = m_rp_depth_map[0].GetProjection(
       m_light.static_fov, 0.1f, m_light.static_distance * 2.0);
   glm::mat4 light_vp = light_projection * light_transform;
-  glm::mat4 model_light_vp = light_vp * m_model_matrix;
-  glm::mat4 terrain_light_vp = light_vp * m_terrain_matrix;
-
-  // Shadow Map Pass
-  m_rp_depth_map[0].Begin();
-
-  // #1 models
-  m_material_shader[0].BeginDepth();
-  m_material_shader[0].SetDepthUniforms(model_light_vp, model_light_vp,
-                                        m_model_matrix);
-  m_rp_material[0].DrawVertices();
-  m_material_shader[0].EndDepth();
-
-  // #2 terrain
-  m_terrain_shader[0].BindHeightmapTexture(m_textures[3]);
-  m_terrain_shader[0].SetDepthUniforms(m_tile_config, terrain_light_vp,
-                                       m_model_matrix);
-  m_terrain_shader[0].BeginDepth();
-  m_rp_terrain[0].DrawVertices(m_tile_config.resolution);
-  m_terrain_shader[0].EndDepth();
-  m_terrain_shader[0].setDepthSkirtUniforms(m_tile_config, terrain_light_vp);
-  m_terrain_shader[0].BeginDepthSkirt();
-  m_rp_terrain[0].DrawSkirt(m_tile_config.resolution);
-  m_terrain_shader[0].EndDepthSkirt();
-
-  // End Shadow Pass
-  m_rp_depth_map[0].End();
-
-  // Draw Material
-  m_material_shader[0].BindDepthTexture(m_rp_depth_map[0].GetTexture());
-  m_material_shader[0].BindMaterialsBuffer(
-      m_rp_material[0].GetMaterialsBuffer());
-  m_material_shader[0].SetUniforms(camera_position, m_light, model_vp,
-                                   model_light_vp, m_model_matrix);
-  m_material_shader[0].Begin();
-  m_rp_material[0].DrawVertices();
-  m_material_shader[0].End();
-
-  // Draw Terrain
-  m_terrain_shader[0].BindMaterialsBuffer(m_rp_terrain[0].GetMaterialsBuffer());
-  m_terrain_shader[0].BindNoiseTexture(m_textures[2]);
-  m_terrain_shader[0].BindHeightmapTexture(m_textures[3]);
-  m_terrain_shader[0].BindBlendTexture(m_textures[4]);
-  m_terrain_shader[0].BindDepthTexture(m_rp_depth_map[0].GetTexture());
-  m_terrain_shader[0].SetUniforms(camera_position, m_light, m_tile_config,
-                                  terrain_vp, terrain_light_vp,
-                                  m_terrain_matrix);
-  m_terrain_shader[0].Begin();
-  m_rp_terrain[0].DrawVertices(m_tile_config.resolution);
-  m_terrain_shader[0].End();
-
-  // draw shadow map to screen
-  // m_rp_tex[0].Draw(m_rp_depth_map[0].GetTexture());
-
-  // 3d icons
-  m_rp_icon[0].Draw(vp * glm::vec4(static_light_pos, 1.0),
-                    glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
-  m_rp_icon[0].Draw(vp * glm::vec4(m_camera.target, 1.0),
-                    glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+
+  VertexDecode model_decode{.offset = glm::vec3{0.0f},
+                            .scale = glm::vec3{1.0f}};
+  if (model != nullptr) {
+    model_decode = model->rp_material.GetVertexDecode();
+  }
+  FrameBlock frame{.view_projection = vp,
+                   .light_view_projection = light_vp,
+                   .camera_pos = glm::vec4(camera_position, 1.0f),
+                   .ambient_light_color =
+                       glm::vec4(m_light.ambient_color, 1.0f),
+                   .light_dir = glm::vec4(m_light.direction, 0.0f),
+                   .light_color = glm::vec4(m_light.diffuse_color, 1.0f),
+                   .specular_power = 32.0f,
+                   .shininess_scale = 2000.0f,
+                   .pad0 = {},
+                   .tile_config = m_tile_config,
+                   .pad1 = {}};
+  m_rp_frame[0].Update(
+      m_stream_buffer[0], frame,
+      {(DrawBlock){.model_matrix = m_model_matrix,
+                   .position_offset = glm::vec4(model_decode.offset, 0.0f),
+                   .position_scale = glm::vec4(model_decode.scale, 0.0f)},
+       (DrawBlock){.model_matrix = m_terrain_matrix,
+                   .position_offset = glm::vec4(0.0f),
+                   .position_scale = glm::vec4(1.0f)}});
+
+  glm::vec2 drawable_size{m_platform->GetDrawableSize()};
+  PassView camera_view{
+      .view_projection = vp,
+      .model_matrix = m_model_matrix,
+      .eye_position = camera_position,
+      .projection_scale = camera_projection[1][1] * drawable_size.y * 0.5f,
+      .pixel_error = m_lod_pixel_error,
+      .occlusion = &m_rp_hiz[0]};
+  PassView light_view{
+      .view_projection = light_vp,
+      .model_matrix = m_model_matrix,
+      .eye_position = static_light_pos,
+      .projection_scale = light_projection[1][1] * kDepthMapSize * 0.5f,
+      .pixel_error = m_lod_pixel_error,
+      .occlusion = nullptr};
+
+  // Passes are declared with what they read and draw into; the graph
+  // orders them, drops the ones nothing on screen depends on, binds their
+  // targets and inputs, and owns the shadow map and Hi-Z depth.
+  m_rp_hiz[0].Update();
+  RenderGraph &graph = m_render_graph;
+  graph.Begin(glm::ivec2(drawable_size), glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
+  RGResource noise = graph.ImportTexture("noise", m_textures[2]);
+  RGResource heightmap = graph.ImportTexture("heightmap", m_textures[3]);
+  RGResource blend =
+      graph.ImportTexture("blend", m_textures[4], GL_TEXTURE_2D_ARRAY);
+  RGResource pyramid =
+      graph.ImportTexture("hiz_pyramid", m_rp_hiz[0].GetPyramidTexture());
+  RGResource hiz_depth =
+      graph.CreateTexture("hiz_depth", m_rp_hiz[0].GetDepthDesc());
+  RGResource shadow_map =
+      graph.CreateTexture("shadow_map", m_rp_depth_map[0].GetTextureDesc());
+  RPTerrainShader &terrain_shader = m_terrain_shader[0];
+  const RGState kDepthOnly{.depth_test = true,
+                           .cull_face = false,
+                           .cull_mode = GL_BACK,
+                           .front_face = GL_CCW};
+  const RGState kLit{.depth_test = true,
+                     .cull_face = true,
+                     .cull_mode = GL_BACK,
+                     .front_face = GL_CCW};
+  const RGState kOverlay{.depth_test = false,
+                         .cull_face = false,
+                         .cull_mode = GL_BACK,
+                         .front_face = GL_CCW};
+
+  // Hi-Z occluders: terrain depth from the camera. Meshes are culled
+  // against the newest pyramid already read back, or this frame's pyramid
+  // when culling on the GPU.
+  graph.AddPass({.name = "hiz_depth",
+                 .reads = {{heightmap,
+                            terrain_shader.GetHeightmapTextureUnit()}},
+                 .target = hiz_depth,
+                 .writes = {},
+                 .state = kDepthOnly,
+                 .enabled = true,
+                 .side_effects = false,
+                 .execute = [&]() {
+                   m_rp_frame[0].BindDraw(kDrawTerrain);
+                   terrain_shader.BeginDepth();
+                   m_rp_terrain[0].DrawVertices(m_tile_config.resolution);
+                   terrain_shader.EndDepth();
+                 }});
+  graph.AddPass({.name = "hiz_pyramid",
+                 .reads = {{hiz_depth, RenderGraph::kNoUnit}},
+                 .target = RenderGraph::kNoTarget,
+                 .writes = {pyramid},
+                 .state = kOverlay,
+                 .enabled = true,
+                 .side_effects = false,
+                 .execute = [&]() {
+                   m_rp_hiz[0].BuildPyramid(vp, graph.GetTexture(hiz_depth));
+                 }});
+
+  // Shadow map: models, then terrain
+  graph.AddPass({.name = "shadow_models",
+                 .reads = {},
+                 .target = shadow_map,
+                 .writes = {},
+                 .state = kDepthOnly,
+                 .enabled = model != nullptr,
+                 .side_effects = false,
+                 .execute = [&]() {
+                   m_rp_frame[0].BindDraw(kDrawModel);
+                   m_material_shader[0].BeginShadow();
+                   m_render_stats.shadow = DrawModel(light_view);
+                   m_material_shader[0].EndShadow();
+                 }});
+  graph.AddPass({.name = "shadow_terrain",
+                 .reads = {{heightmap,
+                            terrain_shader.GetHeightmapTextureUnit()}},
+                 .target = shadow_map,
+                 .writes = {},
+                 .state = kDepthOnly,
+                 .enabled = true,
+                 .side_effects = false,
+                 .execute = [&]() {
+                   m_rp_frame[0].BindDraw(kDrawTerrain);
+                   terrain_shader.BeginShadow();
+                   m_rp_terrain[0].DrawVertices(m_tile_config.resolution);
+                   terrain_shader.EndShadow();
+                   terrain_shader.BeginShadowSkirt();
+                   m_rp_terrain[0].DrawSkirt(m_tile_config.resolution);
+                   terrain_shader.EndShadowSkirt();
+                 }});
+
+  // Lit passes. Culling against the pyramid makes the Hi-Z passes a
+  // dependency of the models, so they are dropped until a model is loaded.
+  graph.AddPass({.name = "models",
+                 .reads = {{shadow_map,
+                            m_material_shader[0].GetDepthTextureUnit()},
+                           {pyramid, RenderGraph::kNoUnit}},
+                 .target = RenderGraph::kBackbuffer,
+                 .writes = {},
+                 .state = kLit,
+                 .enabled = model != nullptr,
+                 .side_effects = false,
+                 .execute = [&]() {
+                   m_material_shader[0].BindMaterialsBuffer(
+                       m_materials_buffer[0]);
+                   m_rp_frame[0].BindDraw(kDrawModel);
+                   m_material_shader[0].Begin();
+                   m_render_stats.material = DrawModel(camera_view);
+                   m_material_shader[0].End();
+                 }});
+  graph.AddPass({.name = "terrain",
+                 .reads = {{shadow_map, terrain_shader.GetDepthTextureUnit()},
+                           {noise, terrain_shader.GetNoiseTextureUnit()},
+                           {heightmap,
+                            terrain_shader.GetHeightmapTextureUnit()},
+                           {blend, terrain_shader.GetBlendTextureUnit()}},
+                 .target = RenderGraph::kBackbuffer,
+                 .writes = {},
+                 .state = kLit,
+                 .enabled = true,
+                 .side_effects = false,
+                 .execute = [&]() {
+                   terrain_shader.BindMaterialsBuffer(m_materials_buffer[0]);
+                   m_rp_frame[0].BindDraw(kDrawTerrain);
+                   terrain_shader.Begin();
+                   m_rp_terrain[0].DrawVertices(m_tile_config.resolution);
+                   terrain_shader.End();
+                 }});
+
+  // Overlays
+  graph.AddPass({.name = "shadow_map_view",
+                 .reads = {{shadow_map, RenderGraph::kNoUnit}},
+                 .target = RenderGraph::kBackbuffer,
+                 .writes = {},
+                 .state = kOverlay,
+                 .enabled = m_show_shadow_map,
+                 .side_effects = false,
+                 .execute = [&]() {
+                   m_rp_tex[0].Draw(graph.GetTexture(shadow_map));
+                 }});
+  graph.AddPass({.name = "icons",
+                 .reads = {},
+                 .target = RenderGraph::kBackbuffer,
+                 .writes = {},
+                 .state = kOverlay,
+                 .enabled = true,
+                 .side_effects = false,
+                 .execute = [&]() {
+                   m_rp_icon[0].Draw(vp * glm::vec4(static_light_pos, 1.0),
+                                     glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
+                   m_rp_icon[0].Draw(vp * glm::vec4(m_camera.target, 1.0),
+                                     glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+                 }});
+
+  m_render_stats.shadow = {};
+  m_render_stats.material = {};
+  graph.Execute();
+  m_render_stats.graph_passes = graph.GetNumExecuted();
+  m_render_stats.graph_culled = graph.GetNumCulled();
+  m_render_stats.graph_targets = graph.GetNumTargets();
+  m_stream_buffer[0].EndFrame();
   m_game_timer.t_finish_draw_calls = SDL_GetPerformanceCounter();
-  RenderGui(m_game_timer, m_camera, m_light, m_tile_config, m_model_matrix);
+  RenderGui(m_game_timer, m_render_stats, m_camera, m_light, m_tile_config,
+            m_model_matrix, m_lod_pixel_error, m_instance_grid,
+            m_gpu_culling, m_shader_quality, m_show_shadow_map);
   m_game_timer.t_finish_gui_draw = SDL_GetPerformanceCounter();
   m_game_timer.t_finish_render = SDL_GetPerformanceCounter();
 }
\ No newline at end of file
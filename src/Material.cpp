@@ -1,4 +1,6 @@
 #include "Material.hpp"
+#include <cstring>
+#include <functional>
 #include <iostream>
 
 // Material Material.002
@@ -40,3 +42,66 @@ Material::Material(const aiMaterial *material) {
   }
 };
 const BSDFMaterial &Material::GetProperties() const { return m_properties; };
+
+// padding is ignored, only the fields the shaders read count
+static size_t HashMaterial(const BSDFMaterial &material) {
+  const float fields[] = {
+      material.ambient_color.x,  material.ambient_color.y,
+      material.ambient_color.z,  material.diffuse_color.x,
+      material.diffuse_color.y,  material.diffuse_color.z,
+      material.specular_color.x, material.specular_color.y,
+      material.specular_color.z, material.shininess};
+  size_t hash = 0;
+  for (float field : fields) {
+    hash ^= std::hash<float>{}(field) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  }
+  return hash;
+}
+
+static bool IsSameMaterial(const BSDFMaterial &a, const BSDFMaterial &b) {
+  return a.ambient_color == b.ambient_color &&
+         a.diffuse_color == b.diffuse_color &&
+         a.specular_color == b.specular_color && a.shininess == b.shininess;
+}
+
+GLint MaterialTable::Find(const BSDFMaterial &material) const {
+  auto range = m_indices.equal_range(HashMaterial(material));
+  for (auto it = range.first; it != range.second; it++) {
+    if (IsSameMaterial(m_materials[it->second], material)) {
+      return it->second;
+    }
+  }
+  return -1;
+};
+
+GLuint MaterialTable::Add(const BSDFMaterial &material) {
+  GLint found = Find(material);
+  if (found >= 0) {
+    return found;
+  }
+  GLuint index = m_materials.size();
+  m_materials.push_back(material);
+  m_indices.emplace(HashMaterial(material), index);
+  return index;
+};
+
+std::vector<GLuint> MaterialTable::AddGroup(const BSDFMaterial *materials,
+                                            GLuint count) {
+  std::vector<GLuint> indices(count);
+  for (GLuint i = 0; i < count; i++) {
+    indices[i] = Add(materials[i]);
+  }
+  return indices;
+};
+
+bool MaterialTable::CanAddGroup(const BSDFMaterial *materials, GLuint count,
+                                GLuint max_size) const {
+  // the group's new materials, deduplicated among themselves like AddGroup
+  MaterialTable added{};
+  for (GLuint i = 0; i < count; i++) {
+    if (Find(materials[i]) < 0) {
+      added.Add(materials[i]);
+    }
+  }
+  return m_materials.size() + added.m_materials.size() <= max_size;
+};
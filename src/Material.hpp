@@ -1,6 +1,9 @@
 #pragma once
+#include "gl.hpp"
 #include <assimp/material.h>
 #include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
 
 struct BSDFMaterial {
   glm::vec3 ambient_color;
@@ -18,4 +21,26 @@ public:
 
 private:
   BSDFMaterial m_properties{};
-};
\ No newline at end of file
+};
+
+// Materials of every loaded MeshGroup and the terrain in one array. Equal
+// materials share an index, so the table grows only with distinct ones.
+class MaterialTable {
+public:
+  GLuint Add(const BSDFMaterial &material);
+  // Table index of each of a group's materials, in the group's order
+  std::vector<GLuint> AddGroup(const BSDFMaterial *materials, GLuint count);
+  // True if the table stays within max_size materials after AddGroup
+  bool CanAddGroup(const BSDFMaterial *materials, GLuint count,
+                   GLuint max_size) const;
+  const std::vector<BSDFMaterial> &GetMaterials() const {
+    return m_materials;
+  };
+
+private:
+  // index of a material equal to material, or -1
+  GLint Find(const BSDFMaterial &material) const;
+  std::vector<BSDFMaterial> m_materials{};
+  // material hash -> index, collisions are told apart by comparing
+  std::unordered_multimap<size_t, GLuint> m_indices{};
+};
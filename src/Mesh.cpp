@@ -1,47 +1,58 @@
 #include "Mesh.hpp"
 #include <glm/glm.hpp>
 
-Mesh::Mesh(const aiMesh *mesh)
-    : m_vertices(mesh->mNumVertices * 3), m_normals(mesh->mNumVertices * 3),
-      m_faces(mesh->mNumFaces * 3) {
-  if (mesh->HasPositions()) {
-    memcpy(&m_vertices[0], mesh->mVertices,
-           m_vertices.size() * sizeof(m_vertices[0]));
+Mesh::Mesh(const aiMesh *mesh) : m_mesh(mesh){};
+Mesh::Mesh(const glm::vec3 *positions, const glm::vec3 *normals,
+           const MeshCorner *corners, GLuint num_corners)
+    : m_positions(positions), m_normals(normals), m_corners(corners),
+      m_num_corners(num_corners){};
+GLuint Mesh::GetNumElements() const {
+  if (m_mesh == nullptr) {
+    return m_num_corners;
   }
-  if (mesh->HasNormals()) {
-    memcpy(&m_normals[0], mesh->mNormals,
-           m_normals.size() * sizeof(m_normals[0]));
+  return m_mesh->HasFaces() ? m_mesh->mNumFaces * 3 : 0;
+}
+GLuint Mesh::GetNumVertices() const {
+  if (m_mesh == nullptr) {
+    return m_num_corners;
   }
-  if (mesh->HasFaces()) {
-    for (uint i = 0; i < mesh->mNumFaces; i++) {
-      uint offset = i * 3;
-      memcpy(&m_faces[offset], mesh->mFaces[i].mIndices,
-             sizeof(m_faces[0]) * 3);
+  return m_mesh->HasPositions() ? m_mesh->mNumVertices : 0;
+}
+void Mesh::WriteElementBuffer(GLuint *elements) const {
+  if (m_mesh == nullptr) {
+    for (GLuint i = 0; i < m_num_corners; i++) {
+      elements[i] = i;
     }
+    return;
   }
-};
-GLsizei Mesh::GetNumElements() const { return m_faces.size(); }
-GLsizei Mesh::GetNumVertices() const { return m_vertices.size() / 3; }
-const std::vector<GLuint> Mesh::GetElementBuffer(uint vertex_offset) const {
-  std::vector<GLuint> element_buffer{m_faces};
-  for (GLuint &idx : element_buffer) {
-    idx += vertex_offset;
+  for (uint i = 0; i < GetNumElements() / 3; i++) {
+    memcpy(&elements[i * 3], m_mesh->mFaces[i].mIndices, sizeof(GLuint) * 3);
   }
-  return element_buffer;
 };
-const std::vector<MeshVertexBuffer>
-Mesh::GetVertexBuffer(GLuint material_idx) const {
-  uint sz = GetNumVertices();
-  std::vector<MeshVertexBuffer> vertex_buffer_data{};
-  vertex_buffer_data.reserve(GetNumVertices());
-  for (uint i = 0; i < sz; i++) {
-    uint offset = i * 3;
-    vertex_buffer_data.emplace_back((MeshVertexBuffer){
-        .position = glm::vec3(m_vertices[offset], m_vertices[offset + 1],
-                              m_vertices[offset + 2]),
-        .normal = glm::vec3(m_normals[offset], m_normals[offset + 1],
-                            m_normals[offset + 2]),
-        .material_idx = material_idx});
+void Mesh::WriteVertexBuffer(MeshVertex *vertices, GLuint material_idx) const {
+  if (m_mesh == nullptr) {
+    for (GLuint i = 0; i < m_num_corners; i++) {
+      const MeshCorner &corner = m_corners[i];
+      glm::vec3 normal{0.0f};
+      if (corner.normal != kNoNormal) {
+        normal = m_normals[corner.normal];
+      }
+      vertices[i] = (MeshVertex){.position = m_positions[corner.position],
+                                 .normal = normal,
+                                 .material_idx = material_idx};
+    }
+    return;
+  }
+  for (uint i = 0; i < GetNumVertices(); i++) {
+    const aiVector3D &position = m_mesh->mVertices[i];
+    glm::vec3 normal{0.0f};
+    if (m_mesh->HasNormals()) {
+      const aiVector3D &n = m_mesh->mNormals[i];
+      normal = glm::vec3(n.x, n.y, n.z);
+    }
+    vertices[i] = (MeshVertex){
+        .position = glm::vec3(position.x, position.y, position.z),
+        .normal = normal,
+        .material_idx = material_idx};
   }
-  return vertex_buffer_data;
 };
@@ -4,23 +4,57 @@
 #include <glm/glm.hpp>
 #include <vector>
 
-struct MeshVertexBuffer {
+// Full precision vertex used while building and optimizing meshes
+struct MeshVertex {
   glm::vec3 position;
   glm::vec3 normal;
   glm::u32 material_idx;
 };
 
+// Packed GPU vertex. Positions are unorm16 within the MeshGroup bounds and
+// decoded with VertexDecode, normals are snorm GL_INT_2_10_10_10_REV.
+struct MeshVertexBuffer {
+  glm::u16vec3 position;
+  glm::u16 material_idx;
+  glm::u32 normal;
+};
+static_assert(sizeof(MeshVertexBuffer) == 12, "MeshVertexBuffer must pack");
+// number of materials the 16-bit material_idx can address
+const GLuint kMaxVertexMaterials = 0x10000;
+
+// position = offset + unorm_position * scale
+struct VertexDecode {
+  glm::vec3 offset;
+  glm::vec3 scale;
+};
+
+// One triangle corner of a source that indexes positions and normals
+// separately, as OBJ faces do
+struct MeshCorner {
+  GLuint position;
+  // kNoNormal when the face has none
+  GLuint normal;
+};
+const GLuint kNoNormal = 0xffffffff;
+
+// Non-owning view that converts one aiMesh, or one list of corners, straight
+// into caller-provided buffers, so importing never keeps a second copy of
+// the scene around.
 class Mesh {
 public:
   Mesh(const aiMesh *mesh);
-  GLsizei GetNumElements() const;
-  GLsizei GetNumVertices() const;
-  const std::vector<GLuint> GetElementBuffer(uint vertex_offset) const;
-  const std::vector<MeshVertexBuffer>
-  GetVertexBuffer(GLuint material_idx) const;
+  // every corner becomes its own vertex, WeldVertices merges them later
+  Mesh(const glm::vec3 *positions, const glm::vec3 *normals,
+       const MeshCorner *corners, GLuint num_corners);
+  GLuint GetNumElements() const;
+  GLuint GetNumVertices() const;
+  void WriteElementBuffer(GLuint *elements) const;
+  void WriteVertexBuffer(MeshVertex *vertices, GLuint material_idx) const;
 
 private:
-  std::vector<GLfloat> m_vertices{};
-  std::vector<GLfloat> m_normals{};
-  std::vector<GLuint> m_faces{};
+  const aiMesh *m_mesh{nullptr};
+  const glm::vec3 *m_positions{nullptr};
+  const glm::vec3 *m_normals{nullptr};
+  const MeshCorner *m_corners{nullptr};
+  GLuint m_num_corners{0};
 };
\ No newline at end of file
@@ -0,0 +1,453 @@
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MeshCache.hpp"
+
+static const char kMeshCacheMagic[4] = {'B', 'M', 'S', 'H'};
+static const uint32_t kMeshCacheVersion = 8;
+static const size_t kSectionAlignment = 16;
+
+struct MeshCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t vertex_size;
+  uint32_t mesh_map_size;
+  uint32_t node_size;
+  uint32_t num_materials;
+  uint32_t num_meshes;
+  uint32_t num_nodes;
+  uint32_t num_vertices;
+  uint32_t num_elements;
+  uint32_t element_type;
+  uint32_t num_dependencies;
+  uint32_t dependency_path_size;
+  float decode_offset[3];
+  float decode_scale[3];
+  int64_t source_mtime;
+  uint64_t source_size;
+  uint64_t materials_offset;
+  uint64_t mesh_map_offset;
+  uint64_t node_offset;
+  uint64_t vertex_offset;
+  uint64_t element_offset;
+  uint64_t dependency_offset;
+  uint64_t dependency_path_offset;
+  uint64_t total_size;
+};
+
+// A file besides the source the import read, stamped like the source. The
+// path is a range of the dependency path section.
+struct MeshCacheDependency {
+  int64_t mtime;
+  uint64_t size;
+  uint32_t path_offset;
+  uint32_t path_size;
+};
+
+struct SourceStamp {
+  int64_t mtime;
+  uint64_t size;
+  bool exists;
+};
+
+static SourceStamp GetSourceStamp(const std::string &source_path) {
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(source_path, ec);
+  if (ec) {
+    return (SourceStamp){.mtime = 0, .size = 0, .exists = false};
+  }
+  uint64_t size = std::filesystem::file_size(source_path, ec);
+  return (SourceStamp){.mtime = (int64_t)mtime.time_since_epoch().count(),
+                       .size = ec ? 0 : size,
+                       .exists = true};
+}
+
+static uint64_t AlignSection(uint64_t offset) {
+  return (offset + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+}
+
+// True if count items of item_size at offset lie in an image of size after
+// the header, written without overflow for any offset and count
+static bool IsSectionInImage(uint64_t offset, uint64_t count,
+                             uint64_t item_size, size_t size) {
+  if (offset < sizeof(MeshCacheHeader) || offset > size ||
+      offset % kSectionAlignment != 0) {
+    return false;
+  }
+  return count <= (size - offset) / item_size;
+}
+
+// Draws fetch the stored indices without a base vertex, each mesh's
+// vertex_offset was already added by MeshGroup::PackElements
+template <typename T>
+static bool AreElementsInRange(const T *elements, const MeshLod &lod,
+                               GLuint num_vertices) {
+  for (GLuint i = 0; i < lod.element_count; i++) {
+    if (elements[lod.element_offset + i] >= num_vertices) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every range GetBuffers and the draws index with has to stay in bounds,
+// the file is not trusted
+static bool ValidateMeshes(const MeshCacheHeader *header, const char *data) {
+  const MeshMap *mesh_map = (const MeshMap *)(data + header->mesh_map_offset);
+  const char *elements = data + header->element_offset;
+  for (GLuint i = 0; i < header->num_meshes; i++) {
+    const MeshMap &mesh = mesh_map[i];
+    if (mesh.num_lods == 0 || mesh.num_lods > kMaxMeshLods ||
+        mesh.node_idx >= header->num_nodes ||
+        mesh.vertex_offset > header->num_vertices ||
+        mesh.material_idx >= header->num_materials) {
+      return false;
+    }
+    for (GLuint l = 0; l < mesh.num_lods; l++) {
+      const MeshLod &lod = mesh.lods[l];
+      if (lod.element_offset > header->num_elements ||
+          lod.element_count > header->num_elements - lod.element_offset) {
+        return false;
+      }
+      bool is_in_range =
+          header->element_type == GL_UNSIGNED_SHORT
+              ? AreElementsInRange((const GLushort *)elements, lod,
+                                   header->num_vertices)
+              : AreElementsInRange((const GLuint *)elements, lod,
+                                   header->num_vertices);
+      if (!is_in_range) {
+        return false;
+      }
+    }
+  }
+  // parents precede their children, see MeshNode
+  const MeshNode *nodes = (const MeshNode *)(data + header->node_offset);
+  for (GLuint i = 0; i < header->num_nodes; i++) {
+    if (nodes[i].parent >= (GLint)i || nodes[i].parent < -1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static std::string GetDependencyPath(const MeshCacheHeader *header,
+                                     const char *data,
+                                     const MeshCacheDependency &dependency) {
+  return std::string(data + header->dependency_path_offset +
+                         dependency.path_offset,
+                     dependency.path_size);
+}
+
+// Every path has to lie in the path section. With check_stamps, each
+// dependency also has to be unchanged since the import, a missing file
+// included.
+static bool ValidateDependencies(const MeshCacheHeader *header,
+                                 const char *data, bool check_stamps) {
+  const MeshCacheDependency *dependencies =
+      (const MeshCacheDependency *)(data + header->dependency_offset);
+  for (GLuint i = 0; i < header->num_dependencies; i++) {
+    const MeshCacheDependency &dependency = dependencies[i];
+    if (dependency.path_offset > header->dependency_path_size ||
+        dependency.path_size >
+            header->dependency_path_size - dependency.path_offset) {
+      return false;
+    }
+    if (!check_stamps) {
+      continue;
+    }
+    SourceStamp stamp =
+        GetSourceStamp(GetDependencyPath(header, data, dependency));
+    if (dependency.mtime != stamp.mtime || dependency.size != stamp.size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A cache is only trusted if its layout matches this build, every section
+// lies within it and, when the source asset is present, it was built from
+// the same version of it and of every file the import read besides it.
+static bool ValidateImage(const char *data, size_t size,
+                          const SourceStamp &stamp) {
+  if (size < sizeof(MeshCacheHeader)) {
+    return false;
+  }
+  const MeshCacheHeader *header = (const MeshCacheHeader *)data;
+  if (memcmp(header->magic, kMeshCacheMagic, sizeof(kMeshCacheMagic)) != 0 ||
+      header->version != kMeshCacheVersion ||
+      header->vertex_size != sizeof(MeshVertexBuffer) ||
+      header->mesh_map_size != sizeof(MeshMap) ||
+      header->node_size != sizeof(MeshNode) ||
+      header->total_size != size) {
+    return false;
+  }
+  if (header->element_type != GL_UNSIGNED_SHORT &&
+      header->element_type != GL_UNSIGNED_INT) {
+    return false;
+  }
+  if (!IsSectionInImage(header->materials_offset, header->num_materials,
+                        sizeof(BSDFMaterial), size) ||
+      !IsSectionInImage(header->mesh_map_offset, header->num_meshes,
+                        sizeof(MeshMap), size) ||
+      !IsSectionInImage(header->node_offset, header->num_nodes,
+                        sizeof(MeshNode), size) ||
+      !IsSectionInImage(header->vertex_offset, header->num_vertices,
+                        sizeof(MeshVertexBuffer), size) ||
+      !IsSectionInImage(header->element_offset, header->num_elements,
+                        GetElementSize(header->element_type), size) ||
+      !IsSectionInImage(header->dependency_offset, header->num_dependencies,
+                        sizeof(MeshCacheDependency), size) ||
+      !IsSectionInImage(header->dependency_path_offset,
+                        header->dependency_path_size, 1, size)) {
+    return false;
+  }
+  if (!ValidateMeshes(header, data)) {
+    return false;
+  }
+  if (stamp.exists && (header->source_mtime != stamp.mtime ||
+                       header->source_size != stamp.size)) {
+    return false;
+  }
+  return ValidateDependencies(header, data, stamp.exists);
+}
+
+MeshCache::MeshCache(const std::string &cache_path,
+                     const std::string &source_path) {
+  int fd = open(cache_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  void *mapping = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return;
+  }
+  m_mapping = mapping;
+  m_mapping_size = st.st_size;
+  m_valid = ValidateImage((const char *)m_mapping, m_mapping_size,
+                          GetSourceStamp(source_path));
+}
+
+MeshCache::MeshCache(std::vector<char> &&image) : m_image{std::move(image)} {
+  m_valid = ValidateImage(m_image.data(), m_image.size(),
+                          (SourceStamp){.mtime = 0, .size = 0, .exists = false});
+}
+
+MeshCache::~MeshCache() {
+  if (m_mapping != nullptr) {
+    munmap(m_mapping, m_mapping_size);
+  }
+}
+
+MeshCache::MeshCache(MeshCache &&other)
+    : m_image{std::move(other.m_image)}, m_mapping{other.m_mapping},
+      m_mapping_size{other.m_mapping_size}, m_valid{other.m_valid} {
+  other.m_mapping = nullptr;
+  other.m_mapping_size = 0;
+  other.m_valid = false;
+}
+
+MeshCache &MeshCache::operator=(MeshCache &&other) {
+  if (this == &other) {
+    return *this;
+  }
+  if (m_mapping != nullptr) {
+    munmap(m_mapping, m_mapping_size);
+  }
+  m_image = std::move(other.m_image);
+  m_mapping = other.m_mapping;
+  m_mapping_size = other.m_mapping_size;
+  m_valid = other.m_valid;
+  other.m_mapping = nullptr;
+  other.m_mapping_size = 0;
+  other.m_valid = false;
+  return *this;
+}
+
+bool MeshCache::IsValid() const { return m_valid; }
+
+const char *MeshCache::GetData() const {
+  if (m_mapping != nullptr) {
+    return (const char *)m_mapping;
+  }
+  return m_image.data();
+}
+
+bool MeshCache::Write(const std::string &cache_path) const {
+  if (!m_valid || m_mapping != nullptr) {
+    return false;
+  }
+  // write to a temporary and rename so a crash never leaves a torn cache
+  const std::string tmp_path = cache_path + ".tmp";
+  {
+    std::ofstream file_stream(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file_stream.is_open()) {
+      std::cerr << "Could not write mesh cache: " << cache_path << std::endl;
+      return false;
+    }
+    file_stream.write(m_image.data(), m_image.size());
+    if (!file_stream.good()) {
+      std::cerr << "Could not write mesh cache: " << cache_path << std::endl;
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, cache_path, ec);
+  return !ec;
+}
+
+MeshBuffers MeshCache::GetBuffers() const {
+  if (!m_valid) {
+    return (MeshBuffers){};
+  }
+  const char *data = GetData();
+  const MeshCacheHeader *header = (const MeshCacheHeader *)data;
+  VertexDecode vertex_decode{};
+  memcpy(&vertex_decode.offset, header->decode_offset, sizeof(float) * 3);
+  memcpy(&vertex_decode.scale, header->decode_scale, sizeof(float) * 3);
+  return (MeshBuffers){
+      .materials = (const BSDFMaterial *)(data + header->materials_offset),
+      .num_materials = header->num_materials,
+      .mesh_map = (const MeshMap *)(data + header->mesh_map_offset),
+      .num_meshes = header->num_meshes,
+      .nodes = (const MeshNode *)(data + header->node_offset),
+      .num_nodes = header->num_nodes,
+      .vertices = (const MeshVertexBuffer *)(data + header->vertex_offset),
+      .num_vertices = header->num_vertices,
+      .vertex_decode = vertex_decode,
+      .elements = data + header->element_offset,
+      .element_type = header->element_type,
+      .num_elements = header->num_elements};
+}
+
+std::vector<std::string> MeshCache::GetDependencies() const {
+  std::vector<std::string> paths{};
+  if (!m_valid) {
+    return paths;
+  }
+  const char *data = GetData();
+  const MeshCacheHeader *header = (const MeshCacheHeader *)data;
+  const MeshCacheDependency *dependencies =
+      (const MeshCacheDependency *)(data + header->dependency_offset);
+  for (GLuint i = 0; i < header->num_dependencies; i++) {
+    paths.push_back(GetDependencyPath(header, data, dependencies[i]));
+  }
+  return paths;
+}
+
+std::vector<char>
+SerializeMeshCache(const std::string &source_path, const MeshBuffers &buffers,
+                   const std::vector<std::string> &dependency_paths) {
+  SourceStamp stamp = GetSourceStamp(source_path);
+  std::vector<MeshCacheDependency> dependencies{};
+  std::string paths{};
+  for (const std::string &path : dependency_paths) {
+    SourceStamp dependency_stamp = GetSourceStamp(path);
+    dependencies.push_back(
+        (MeshCacheDependency){.mtime = dependency_stamp.mtime,
+                              .size = dependency_stamp.size,
+                              .path_offset = (uint32_t)paths.size(),
+                              .path_size = (uint32_t)path.size()});
+    paths += path;
+  }
+  MeshCacheHeader header{};
+  memcpy(header.magic, kMeshCacheMagic, sizeof(kMeshCacheMagic));
+  header.version = kMeshCacheVersion;
+  header.vertex_size = sizeof(MeshVertexBuffer);
+  header.mesh_map_size = sizeof(MeshMap);
+  header.node_size = sizeof(MeshNode);
+  header.num_materials = buffers.num_materials;
+  header.num_meshes = buffers.num_meshes;
+  header.num_nodes = buffers.num_nodes;
+  header.num_vertices = buffers.num_vertices;
+  header.num_elements = buffers.num_elements;
+  header.element_type = buffers.element_type;
+  header.num_dependencies = dependencies.size();
+  header.dependency_path_size = paths.size();
+  const VertexDecode &decode = buffers.vertex_decode;
+  memcpy(header.decode_offset, &decode.offset, sizeof(float) * 3);
+  memcpy(header.decode_scale, &decode.scale, sizeof(float) * 3);
+  header.source_mtime = stamp.mtime;
+  header.source_size = stamp.size;
+
+  size_t materials_size = buffers.num_materials * sizeof(BSDFMaterial);
+  size_t mesh_map_size = buffers.num_meshes * sizeof(MeshMap);
+  size_t node_size = buffers.num_nodes * sizeof(MeshNode);
+  size_t vertex_size = buffers.num_vertices * sizeof(MeshVertexBuffer);
+  size_t element_size =
+      buffers.num_elements * GetElementSize(buffers.element_type);
+  header.materials_offset = AlignSection(sizeof(MeshCacheHeader));
+  header.mesh_map_offset = AlignSection(header.materials_offset + materials_size);
+  header.node_offset = AlignSection(header.mesh_map_offset + mesh_map_size);
+  header.vertex_offset = AlignSection(header.node_offset + node_size);
+  header.element_offset = AlignSection(header.vertex_offset + vertex_size);
+  header.dependency_offset =
+      AlignSection(header.element_offset + element_size);
+  header.dependency_path_offset = AlignSection(
+      header.dependency_offset +
+      dependencies.size() * sizeof(MeshCacheDependency));
+  header.total_size = header.dependency_path_offset + paths.size();
+
+  std::vector<char> image(header.total_size);
+  memcpy(&image[0], &header, sizeof(header));
+  if (materials_size) {
+    memcpy(&image[header.materials_offset], buffers.materials, materials_size);
+  }
+  if (mesh_map_size) {
+    memcpy(&image[header.mesh_map_offset], buffers.mesh_map, mesh_map_size);
+  }
+  if (node_size) {
+    memcpy(&image[header.node_offset], buffers.nodes, node_size);
+  }
+  if (vertex_size) {
+    memcpy(&image[header.vertex_offset], buffers.vertices, vertex_size);
+  }
+  if (element_size) {
+    memcpy(&image[header.element_offset], buffers.elements, element_size);
+  }
+  if (!dependencies.empty()) {
+    memcpy(&image[header.dependency_offset], dependencies.data(),
+           dependencies.size() * sizeof(MeshCacheDependency));
+  }
+  if (!paths.empty()) {
+    memcpy(&image[header.dependency_path_offset], paths.data(), paths.size());
+  }
+  return image;
+}
+
+std::string GetMeshCachePath(const std::string &p_file) {
+  return p_file + ".meshcache";
+}
+
+MeshCache ImportCached(const std::string &p_file) {
+  const std::string cache_path = GetMeshCachePath(p_file);
+  MeshCache cache{cache_path, p_file};
+  if (cache.IsValid()) {
+    std::cout << "Loaded mesh cache:" << cache_path << std::endl;
+    return cache;
+  }
+  // OBJ files skip assimp, see LoadObj
+  bool is_obj = std::filesystem::path(p_file).extension() == ".obj";
+  MeshGroup mesh_group{is_obj ? ImportObj(p_file) : Import(p_file)};
+  MeshCache imported{SerializeMeshCache(p_file, mesh_group.GetBuffers(),
+                                        mesh_group.GetDependencies())};
+  if (imported.Write(cache_path)) {
+    std::cout << "Wrote mesh cache:" << cache_path << std::endl;
+  }
+  return imported;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MeshGroup.hpp"
+#include "utils.hpp"
+
+// Binary image of a MeshGroup in GPU-ready layout. A cache hit is a single
+// mmap; the sections are handed to RPMaterial without any parsing.
+class MeshCache {
+public:
+  MeshCache(const std::string &cache_path, const std::string &source_path);
+  MeshCache(std::vector<char> &&image);
+  ~MeshCache();
+  NEVER_COPY(MeshCache);
+  MeshCache(MeshCache &&other);
+  MeshCache &operator=(MeshCache &&other);
+  bool IsValid() const;
+  bool Write(const std::string &cache_path) const;
+  MeshBuffers GetBuffers() const;
+  // What MeshGroup::GetDependencies was when the cache was written
+  std::vector<std::string> GetDependencies() const;
+
+private:
+  const char *GetData() const;
+  std::vector<char> m_image{};
+  void *m_mapping{nullptr};
+  size_t m_mapping_size{0};
+  bool m_valid{false};
+};
+
+// Stamps the source and every dependency; the cache only loads while none
+// of them changed
+std::vector<char>
+SerializeMeshCache(const std::string &source_path, const MeshBuffers &buffers,
+                   const std::vector<std::string> &dependency_paths);
+std::string GetMeshCachePath(const std::string &p_file);
+MeshCache ImportCached(const std::string &p_file);
@@ -1,7 +1,13 @@
+#include <algorithm>
 #include <assimp/Importer.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <numeric>
 
 #include "MeshGroup.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
 #include "utils.hpp"
 
 MeshGroup Import(const std::string &p_file) {
@@ -11,74 +17,468 @@ MeshGroup Import(const std::string &p_file) {
   if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
       !scene->mRootNode) {
     std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
-    return nullptr;
+    return MeshGroup{ObjModel{}};
   }
   return MeshGroup{scene};
 }
 
+MeshGroup ImportObj(const std::string &p_file) {
+  ObjModel model{};
+  if (!LoadObj(p_file, model)) {
+    return Import(p_file);
+  }
+  return MeshGroup{model};
+}
+
+struct MeshBounds {
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+static MeshBounds CalcBounds(const MeshVertex *vertices, GLuint num_vertices) {
+  MeshBounds bounds{.min = glm::vec3{0.0f}, .max = glm::vec3{0.0f}};
+  if (num_vertices > 0) {
+    bounds.min = bounds.max = vertices[0].position;
+  }
+  for (GLuint i = 0; i < num_vertices; i++) {
+    bounds.min = glm::min(bounds.min, vertices[i].position);
+    bounds.max = glm::max(bounds.max, vertices[i].position);
+  }
+  return bounds;
+}
+
+static void CalcBoundingVolumes(const MeshVertex *vertices,
+                                GLuint num_vertices, const MeshBounds &bounds,
+                                MeshMap &mesh_map) {
+  mesh_map.center = (bounds.min + bounds.max) * 0.5f;
+  mesh_map.extent = (bounds.max - bounds.min) * 0.5f;
+  mesh_map.radius = 0.0f;
+  for (GLuint i = 0; i < num_vertices; i++) {
+    mesh_map.radius = glm::max(
+        mesh_map.radius, glm::distance(mesh_map.center, vertices[i].position));
+  }
+}
+
 MeshGroup::MeshGroup(const aiScene *scene) {
   // Construct m_materials
   for (uint i = 0; i < scene->mNumMaterials; i++) {
     AddMaterial(scene->mMaterials[i]);
   }
 
-  // Construct m_meshes, m_mesh_map
-  uint vertex_offset = 0;
-  uint element_offset = 0;
-  auto ProcessNode = [&](auto &ProcessNode, const aiNode *node) -> void {
+  // Collect nodes depth-first and their meshes in the same order, and
+  // construct m_nodes, m_mesh_map
+  std::vector<Mesh> meshes{};
+  auto ProcessNode = [&](auto &ProcessNode, const aiNode *node,
+                         GLint parent) -> void {
+    GLuint node_idx = m_nodes.size();
+    // aiMatrix4x4 is row-major
+    m_nodes.push_back((MeshNode){
+        .transform = glm::transpose(glm::make_mat4(&node->mTransformation.a1)),
+        .parent = parent});
+    // a node's meshes are ordered by material so draws of one material
+    // are adjacent
+    std::vector<const aiMesh *> node_meshes(node->mNumMeshes);
     for (uint i = 0; i < node->mNumMeshes; i++) {
-      const aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-      uint mesh_idx = AddMesh(mesh, vertex_offset, element_offset);
-      element_offset += m_meshes[mesh_idx].GetNumElements();
-      vertex_offset += m_meshes[mesh_idx].GetNumVertices();
+      node_meshes[i] = scene->mMeshes[node->mMeshes[i]];
+    }
+    std::stable_sort(node_meshes.begin(), node_meshes.end(),
+                     [](const aiMesh *a, const aiMesh *b) {
+                       return a->mMaterialIndex < b->mMaterialIndex;
+                     });
+    for (const aiMesh *mesh : node_meshes) {
+      meshes.emplace_back(mesh);
+      m_mesh_map.push_back((MeshMap){.material_idx = mesh->mMaterialIndex,
+                                     .node_idx = node_idx});
     }
     for (uint i = 0; i < node->mNumChildren; i++) {
-      ProcessNode(ProcessNode, node->mChildren[i]);
+      ProcessNode(ProcessNode, node->mChildren[i], node_idx);
     }
   };
-  ProcessNode(ProcessNode, scene->mRootNode);
+  ProcessNode(ProcessNode, scene->mRootNode, -1);
+  BuildBuffers(meshes);
+};
+
+MeshGroup::MeshGroup(const ObjModel &model) {
+  m_materials = model.materials;
+  m_dependencies = model.material_libraries;
+  m_nodes.push_back((MeshNode){.transform = glm::mat4{1.0f}, .parent = -1});
+  for (GLuint i = 0; i < model.num_objects; i++) {
+    m_nodes.push_back((MeshNode){.transform = glm::mat4{1.0f}, .parent = 0});
+  }
+  // node-major like the assimp path, ordered by material within a node
+  std::vector<GLuint> order(model.meshes.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+    const ObjMesh &mesh_a = model.meshes[a];
+    const ObjMesh &mesh_b = model.meshes[b];
+    return std::make_pair(mesh_a.object_idx, mesh_a.material_idx) <
+           std::make_pair(mesh_b.object_idx, mesh_b.material_idx);
+  });
+  std::vector<Mesh> meshes{};
+  for (GLuint mesh_idx : order) {
+    const ObjMesh &mesh = model.meshes[mesh_idx];
+    meshes.emplace_back(model.positions.data(), model.normals.data(),
+                        mesh.corners.data(), mesh.corners.size());
+    m_mesh_map.push_back((MeshMap){.material_idx = mesh.material_idx,
+                                   .node_idx = 1 + mesh.object_idx});
+  }
+  BuildBuffers(meshes);
+};
+
+void MeshGroup::BuildBuffers(const std::vector<Mesh> &meshes) {
+  // vertices could not tell the materials apart, so the group is left
+  // empty like a file that failed to import
+  if (m_materials.size() > kMaxVertexMaterials) {
+    std::cerr << "Too many materials to import: " << m_materials.size()
+              << ", at most " << kMaxVertexMaterials << std::endl;
+    m_materials.clear();
+    m_mesh_map.clear();
+    BuildBuffers({});
+    return;
+  }
+  const uint num_meshes = meshes.size();
+
+  // Every mesh converts into its own slice of one staging buffer, so all
+  // offsets are known before any mesh is touched. Optimizing only ever
+  // shrinks a mesh, so it stays inside its slice.
+  std::vector<GLuint> source_vertex_offsets(num_meshes + 1, 0);
+  std::vector<GLuint> source_element_offsets(num_meshes + 1, 0);
+  for (uint mesh_idx = 0; mesh_idx < num_meshes; mesh_idx++) {
+    source_vertex_offsets[mesh_idx + 1] =
+        source_vertex_offsets[mesh_idx] + meshes[mesh_idx].GetNumVertices();
+    source_element_offsets[mesh_idx + 1] =
+        source_element_offsets[mesh_idx] + meshes[mesh_idx].GetNumElements();
+  }
+  std::vector<MeshVertex> vertices(source_vertex_offsets[num_meshes]);
+  std::vector<GLuint> elements(source_element_offsets[num_meshes]);
+
+  // Convert, optimize for the post-transform cache and vertex fetch, and
+  // simplify every mesh in parallel
+  std::vector<GLuint> num_mesh_vertices(num_meshes, 0);
+  std::vector<MeshBounds> mesh_bounds(num_meshes);
+  std::vector<MeshOptimizeStats> mesh_stats(num_meshes);
+  std::vector<std::vector<std::vector<GLuint>>> mesh_lods(num_meshes);
+  ParallelFor(num_meshes, [&](uint mesh_idx) {
+    const Mesh &mesh = meshes[mesh_idx];
+    MeshMap &mesh_map = m_mesh_map[mesh_idx];
+    MeshVertex *mesh_vertices =
+        vertices.data() + source_vertex_offsets[mesh_idx];
+    GLuint *mesh_elements = elements.data() + source_element_offsets[mesh_idx];
+    mesh.WriteVertexBuffer(mesh_vertices, mesh_map.material_idx);
+    mesh.WriteElementBuffer(mesh_elements);
+    GLuint num_vertices =
+        OptimizeMesh(mesh_vertices, mesh.GetNumVertices(), mesh_elements,
+                     mesh.GetNumElements(), mesh_stats[mesh_idx]);
+    num_mesh_vertices[mesh_idx] = num_vertices;
+    mesh_bounds[mesh_idx] = CalcBounds(mesh_vertices, num_vertices);
+    CalcBoundingVolumes(mesh_vertices, num_vertices, mesh_bounds[mesh_idx],
+                        mesh_map);
+    mesh_lods[mesh_idx] =
+        GenerateLods(mesh_vertices, num_vertices, mesh_elements,
+                     mesh.GetNumElements(), mesh_map);
+  });
+
+  MeshOptimizeStats stats{};
+  for (const MeshOptimizeStats &s : mesh_stats) {
+    stats.num_vertices_before += s.num_vertices_before;
+    stats.num_vertices_after += s.num_vertices_after;
+    stats.num_triangles += s.num_triangles;
+    stats.cache_misses_before += s.cache_misses_before;
+    stats.cache_misses_after += s.cache_misses_after;
+  }
+  if (stats.num_triangles > 0) {
+    printf("Optimized meshes: vertices %u -> %u, ACMR %.3f -> %.3f\n",
+           stats.num_vertices_before, stats.num_vertices_after,
+           1.0f * stats.cache_misses_before / stats.num_triangles,
+           1.0f * stats.cache_misses_after / stats.num_triangles);
+  }
 
-  // Construct client m_vertex_buffer/m_element_buffer
-  m_element_buffer.reserve(GetNumElements());
-  m_vertex_buffer.reserve(GetNumVertices());
-  for (uint mesh_idx = 0; mesh_idx < m_meshes.size(); mesh_idx++) {
-    const Mesh &mesh = m_meshes[mesh_idx];
+  // Final offsets. Vertices go mesh by mesh, elements LOD-major so
+  // neighbouring meshes drawn at the same LOD are contiguous and can be
+  // merged into one draw.
+  GLuint num_vertices = 0;
+  bool has_bounds = false;
+  MeshBounds bounds{.min = glm::vec3{0.0f}, .max = glm::vec3{0.0f}};
+  for (uint mesh_idx = 0; mesh_idx < num_meshes; mesh_idx++) {
+    m_mesh_map[mesh_idx].vertex_offset = num_vertices;
+    num_vertices += num_mesh_vertices[mesh_idx];
+    if (num_mesh_vertices[mesh_idx] == 0) {
+      continue;
+    }
+    const MeshBounds &mb = mesh_bounds[mesh_idx];
+    bounds.min = has_bounds ? glm::min(bounds.min, mb.min) : mb.min;
+    bounds.max = has_bounds ? glm::max(bounds.max, mb.max) : mb.max;
+    has_bounds = true;
+  }
+  m_num_elements = 0;
+  for (GLuint lod = 0; lod < kMaxMeshLods; lod++) {
+    for (MeshMap &mesh_map : m_mesh_map) {
+      if (lod < mesh_map.num_lods) {
+        mesh_map.lods[lod].element_offset = m_num_elements;
+        m_num_elements += mesh_map.lods[lod].element_count;
+      }
+    }
+  }
+
+  // Pack every mesh straight into the preallocated final buffers
+  m_vertex_decode = {.offset = bounds.min, .scale = bounds.max - bounds.min};
+  m_vertex_buffer.resize(num_vertices);
+  m_element_type = GL_UNSIGNED_INT;
+  if (num_vertices <= 0x10000) {
+    m_element_type = GL_UNSIGNED_SHORT;
+    m_short_element_buffer.resize(m_num_elements);
+  } else {
+    m_element_buffer.resize(m_num_elements);
+  }
+  ParallelFor(num_meshes, [&](uint mesh_idx) {
     const MeshMap &mesh_map = m_mesh_map[mesh_idx];
-    const std::vector<GLuint> element_buffer =
-        mesh.GetElementBuffer(mesh_map.vertex_offset);
-    const std::vector<MeshVertexBuffer> vertex_buffer =
-        mesh.GetVertexBuffer(mesh_map.material_idx);
-    m_element_buffer.insert(m_element_buffer.end(), element_buffer.begin(),
-                            element_buffer.end());
-    m_vertex_buffer.insert(m_vertex_buffer.end(), vertex_buffer.begin(),
-                           vertex_buffer.end());
+    PackVertices(vertices.data() + source_vertex_offsets[mesh_idx],
+                 num_mesh_vertices[mesh_idx], mesh_map.vertex_offset);
+    for (GLuint lod = 0; lod < mesh_map.num_lods; lod++) {
+      const GLuint *lod_elements =
+          lod == 0 ? elements.data() + source_element_offsets[mesh_idx]
+                   : mesh_lods[mesh_idx][lod - 1].data();
+      PackElements(lod_elements, mesh_map.lods[lod], mesh_map.vertex_offset);
+    }
+  });
+};
+
+std::vector<std::vector<GLuint>>
+MeshGroup::GenerateLods(const MeshVertex *vertices, GLuint num_vertices,
+                        const GLuint *elements, GLuint num_elements,
+                        MeshMap &mesh_map) {
+  // each LOD halves the triangle count of the previous one until the error
+  // grows past a fraction of the mesh size or simplification stalls. LOD 0
+  // stays in the caller's buffer, only the coarser LODs are returned.
+  const GLuint kMinLodElements = 3 * 32;
+  const float kMaxLodError = 0.1f * mesh_map.radius;
+  std::vector<std::vector<GLuint>> lods{};
+  mesh_map.lods[0] = (MeshLod){.element_count = num_elements, .error = 0.0f};
+  mesh_map.num_lods = 1;
+  const GLuint *previous = elements;
+  GLuint previous_count = num_elements;
+  float error = 0.0f;
+  while (mesh_map.num_lods < kMaxMeshLods) {
+    GLuint target_elements = previous_count / 6 * 3;
+    if (target_elements < kMinLodElements) {
+      break;
+    }
+    float lod_error = 0.0f;
+    std::vector<GLuint> simplified =
+        SimplifyMesh(vertices, num_vertices, previous, previous_count,
+                     target_elements, kMaxLodError - error, lod_error);
+    if (simplified.size() * 4 > previous_count * 3) {
+      break;
+    }
+    std::vector<GLuint> cluster_offsets;
+    OptimizeVertexCache(simplified.data(), simplified.size(), num_vertices,
+                        cluster_offsets);
+    // errors of a chain simplified from the previous LOD add up
+    error += lod_error;
+    mesh_map.lods[mesh_map.num_lods++] = (MeshLod){
+        .element_count = (GLuint)simplified.size(), .error = error};
+    lods.push_back(std::move(simplified));
+    previous = lods.back().data();
+    previous_count = lods.back().size();
+  }
+  return lods;
+};
+
+void MeshGroup::PackVertices(const MeshVertex *vertices, GLuint num_vertices,
+                             GLuint vertex_offset) {
+  glm::vec3 encode_scale{0.0f};
+  for (int i = 0; i < 3; i++) {
+    if (m_vertex_decode.scale[i] > 0.0f) {
+      encode_scale[i] = 65535.0f / m_vertex_decode.scale[i];
+    }
+  }
+  for (GLuint i = 0; i < num_vertices; i++) {
+    const MeshVertex &vertex = vertices[i];
+    glm::vec3 unorm_position = glm::round(
+        glm::clamp((vertex.position - m_vertex_decode.offset) * encode_scale,
+                   0.0f, 65535.0f));
+    m_vertex_buffer[vertex_offset + i] = (MeshVertexBuffer){
+        .position = glm::u16vec3(unorm_position),
+        .material_idx = (glm::u16)vertex.material_idx,
+        .normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0.0f))};
+  }
+};
+
+void MeshGroup::PackElements(const GLuint *elements, const MeshLod &lod,
+                             GLuint vertex_offset) {
+  for (GLuint i = 0; i < lod.element_count; i++) {
+    GLuint idx = elements[i] + vertex_offset;
+    if (m_element_type == GL_UNSIGNED_SHORT) {
+      m_short_element_buffer[lod.element_offset + i] = idx;
+    } else {
+      m_element_buffer[lod.element_offset + i] = idx;
+    }
   }
 };
 
-GLuint MeshGroup::GetNumElements() const { return m_element_buffer.size(); };
+GLuint MeshGroup::GetNumElements() const { return m_num_elements; };
 GLuint MeshGroup::GetNumVertices() const { return m_vertex_buffer.size(); };
 
-const std::vector<Material> &MeshGroup::GetMaterials() const {
+const std::vector<BSDFMaterial> &MeshGroup::GetMaterials() const {
   return m_materials;
 };
+const std::vector<MeshMap> &MeshGroup::GetMeshMap() const {
+  return m_mesh_map;
+};
+const std::vector<MeshNode> &MeshGroup::GetNodes() const { return m_nodes; };
 const std::vector<MeshVertexBuffer> &MeshGroup::GetVertexBuffer() const {
   return m_vertex_buffer;
 };
-const std::vector<GLuint> &MeshGroup::GetElementBuffer() const {
-  return m_element_buffer;
+GLenum MeshGroup::GetElementType() const { return m_element_type; };
+const VertexDecode &MeshGroup::GetVertexDecode() const {
+  return m_vertex_decode;
+};
+MeshBuffers MeshGroup::GetBuffers() const {
+  const void *elements = m_element_buffer.data();
+  if (m_element_type == GL_UNSIGNED_SHORT) {
+    elements = m_short_element_buffer.data();
+  }
+  return (MeshBuffers){.materials = m_materials.data(),
+                       .num_materials = (GLuint)m_materials.size(),
+                       .mesh_map = m_mesh_map.data(),
+                       .num_meshes = (GLuint)m_mesh_map.size(),
+                       .nodes = m_nodes.data(),
+                       .num_nodes = (GLuint)m_nodes.size(),
+                       .vertices = m_vertex_buffer.data(),
+                       .num_vertices = (GLuint)m_vertex_buffer.size(),
+                       .vertex_decode = m_vertex_decode,
+                       .elements = elements,
+                       .element_type = m_element_type,
+                       .num_elements = m_num_elements};
+};
+const std::vector<std::string> &MeshGroup::GetDependencies() const {
+  return m_dependencies;
 };
 
 uint MeshGroup::AddMaterial(const aiMaterial *material) {
-  m_materials.emplace_back(material);
+  m_materials.push_back(Material{material}.GetProperties());
   return m_materials.size() - 1;
 };
 
-uint MeshGroup::AddMesh(const aiMesh *mesh, GLuint vertex_offset,
-                        GLuint element_offset) {
-  m_meshes.emplace_back(mesh);
-  uint mesh_idx = m_meshes.size() - 1;
-  m_mesh_map.push_back((MeshMap){.material_idx = mesh->mMaterialIndex,
-                                 .vertex_offset = vertex_offset,
-                                 .element_offset = element_offset});
-  return mesh_idx;
+void PrintMaterial(const aiMaterial *material) {
+  printf("Material %s\n", material->GetName().C_Str());
+  for (uint j = 0; j < material->mNumProperties; j++) {
+    aiMaterialProperty *prop = material->mProperties[j];
+    aiPropertyTypeInfo prop_type = prop->mType;
+
+    const char *p_key = prop->mKey.C_Str();
+    printf("%s ", p_key);
+    switch (prop_type) {
+    case aiPTI_Float: {
+      float *float_out = (float *)prop->mData;
+      uint size = prop->mDataLength / sizeof(float);
+      for (uint k = 0; k < size; k++) {
+        printf("%.2f", float_out[k]);
+        if (k != size - 1) {
+          printf(", ");
+        }
+      }
+      break;
+    };
+    case aiPTI_Double: {
+      double *double_out = (double *)prop->mData;
+      uint size = prop->mDataLength / sizeof(double);
+      for (uint k = 0; k < size; k++) {
+        printf("%.2f", double_out[k]);
+        if (k != size - 1) {
+          printf(", ");
+        }
+      }
+      break;
+    }
+    case aiPTI_String: {
+      aiString string_out;
+      material->Get(p_key, prop_type, 0, string_out);
+      printf("%s", string_out.C_Str());
+      break;
+    }
+    case aiPTI_Integer: {
+      int *integer_out = (int *)prop->mData;
+      uint size = prop->mDataLength / sizeof(int);
+      for (uint k = 0; k < size; k++) {
+        printf("%i", integer_out[k]);
+        if (k != size - 1) {
+          printf(", ");
+        }
+      }
+      break;
+    }
+    case aiPTI_Buffer:
+    case _aiPTI_Force32Bit:
+      // no printable representation
+      break;
+    }
+    printf("\n");
+  }
+}
+
+void PrintVertices(const aiMesh *mesh) {
+  for (uint j = 0; j < mesh->mNumVertices; j++) {
+    aiVector3D vertex = mesh->mVertices[j];
+    printf("v %.2f,%.2f,%.2f\n", vertex.x, vertex.y, vertex.z);
+  }
+}
+
+void PrintNormals(const aiMesh *mesh) {
+  if (mesh->mNormals) {
+    for (uint j = 0; j < mesh->mNumVertices; j++) {
+      aiVector3D vertex = mesh->mNormals[j];
+      printf("vn %.2f,%.2f,%.2f\n", vertex.x, vertex.y, vertex.z);
+    }
+  }
+}
+
+void PrintTexCoords(const aiMesh *mesh) {
+  for (uint j = 0; j < AI_MAX_NUMBER_OF_TEXTURECOORDS; j++) {
+    if (!mesh->mTextureCoords[j])
+      continue;
+    const aiString *tex_coords_name = mesh->GetTextureCoordsName(j);
+    if (tex_coords_name) {
+      printf("tex_coords %s\n", tex_coords_name->C_Str());
+    } else {
+      printf("unnamed tex_coords\n");
+    }
+    for (uint k = 0; k < mesh->mNumVertices; k++) {
+      aiVector3D tex_coords = mesh->mTextureCoords[j][k];
+      printf("vt %.2f,%.2f,%.2f\n", tex_coords.x, tex_coords.y, tex_coords.z);
+    }
+  }
+}
+
+void PrintFaces(const aiMesh *mesh) {
+  for (uint j = 0; j < mesh->mNumFaces; j++) {
+    aiFace face = mesh->mFaces[j];
+    printf("f ");
+    for (uint k = 0; k < face.mNumIndices; k++) {
+      printf("%u", face.mIndices[k]);
+      if (k != face.mNumIndices - 1) {
+        printf("/");
+      } else {
+        printf("\n");
+      }
+    }
+  }
+}
+
+void PrintNode(aiNode *node, const aiScene *scene) {
+  printf("##Node##\n");
+  printf("%u meshes.\n", node->mNumMeshes);
+  printf("%u children.\n", node->mNumChildren);
+  for (uint i = 0; i < node->mNumMeshes; i++) {
+    printf("Mesh#%u\n", i);
+    aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
+    PrintMaterial(scene->mMaterials[mesh->mMaterialIndex]);
+    PrintVertices(mesh);
+    PrintNormals(mesh);
+    PrintTexCoords(mesh);
+    PrintFaces(mesh);
+  }
+  for (uint i = 0; i < node->mNumChildren; i++) {
+    PrintNode(node->mChildren[i], scene);
+  }
 }
@@ -7,31 +7,110 @@
 
 #include "Material.hpp"
 #include "Mesh.hpp"
+#include "ObjLoader.hpp"
 #include "utils.hpp"
 
+const GLuint kMaxMeshLods = 4;
+
+struct MeshLod {
+  GLuint element_offset;
+  GLuint element_count;
+  // object-space distance the LOD may deviate from the full detail mesh
+  float error;
+};
+
+// One aiNode. Nodes are stored in depth-first order, so a parent always
+// precedes its children and every subtree is a contiguous range.
+struct MeshNode {
+  glm::mat4 transform;
+  // -1 for a root
+  GLint parent;
+};
+
 struct MeshMap {
   GLuint material_idx;
   GLuint vertex_offset;
-  GLuint element_offset;
+  // node whose world matrix places the mesh
+  GLuint node_idx;
+  // lods[0] is the full detail mesh
+  GLuint num_lods;
+  MeshLod lods[kMaxMeshLods];
+  // node-space bounding sphere center +- radius and box center +- extent
+  glm::vec3 center;
+  float radius;
+  glm::vec3 extent;
+};
+
+// Non-owning view of GPU-ready mesh data. Backed either by a MeshGroup or by
+// a mapped MeshCache, so RPMaterial uploads both the same way.
+struct MeshBuffers {
+  const BSDFMaterial *materials;
+  GLuint num_materials;
+  const MeshMap *mesh_map;
+  GLuint num_meshes;
+  const MeshNode *nodes;
+  GLuint num_nodes;
+  const MeshVertexBuffer *vertices;
+  GLuint num_vertices;
+  VertexDecode vertex_decode;
+  const void *elements;
+  GLenum element_type;
+  GLuint num_elements;
 };
 
+inline GLuint GetElementSize(GLenum element_type) {
+  return element_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
 class MeshGroup {
 public:
   MeshGroup(const aiScene *scene);
+  // One root node with a child per OBJ object
+  MeshGroup(const ObjModel &model);
   GLuint GetNumElements() const;
   GLuint GetNumVertices() const;
-  const std::vector<Material> &GetMaterials() const;
+  const std::vector<BSDFMaterial> &GetMaterials() const;
+  const std::vector<MeshMap> &GetMeshMap() const;
+  const std::vector<MeshNode> &GetNodes() const;
   const std::vector<MeshVertexBuffer> &GetVertexBuffer() const;
-  const std::vector<GLuint> &GetElementBuffer() const;
+  GLenum GetElementType() const;
+  const VertexDecode &GetVertexDecode() const;
+  MeshBuffers GetBuffers() const;
+  // Files besides the source the import read, like OBJ material libraries
+  const std::vector<std::string> &GetDependencies() const;
 
 private:
+  // Converts, optimizes, simplifies and packs meshes, which line up with
+  // m_mesh_map
+  void BuildBuffers(const std::vector<Mesh> &meshes);
+  std::vector<std::vector<GLuint>>
+  GenerateLods(const MeshVertex *vertices, GLuint num_vertices,
+               const GLuint *elements, GLuint num_elements, MeshMap &mesh_map);
+  void PackVertices(const MeshVertex *vertices, GLuint num_vertices,
+                    GLuint vertex_offset);
+  void PackElements(const GLuint *elements, const MeshLod &lod,
+                    GLuint vertex_offset);
   uint AddMaterial(const aiMaterial *material);
-  uint AddMesh(const aiMesh *mesh, GLuint vertex_offset, GLuint element_offset);
-  std::vector<Mesh> m_meshes{};
   std::vector<MeshMap> m_mesh_map{};
-  std::vector<Material> m_materials{};
+  std::vector<MeshNode> m_nodes{};
+  std::vector<BSDFMaterial> m_materials{};
   std::vector<GLuint> m_element_buffer{};
+  std::vector<GLushort> m_short_element_buffer{};
   std::vector<MeshVertexBuffer> m_vertex_buffer{};
+  VertexDecode m_vertex_decode{};
+  GLenum m_element_type{GL_UNSIGNED_INT};
+  GLuint m_num_elements{0};
+  std::vector<std::string> m_dependencies{};
 };
 
-MeshGroup Import(const std::string &p_file);
\ No newline at end of file
+MeshGroup Import(const std::string &p_file);
+// LoadObj instead of assimp, falls back to Import if it fails
+MeshGroup ImportObj(const std::string &p_file);
+
+// Debug output of imported assimp data
+void PrintMaterial(const aiMaterial *material);
+void PrintVertices(const aiMesh *mesh);
+void PrintNormals(const aiMesh *mesh);
+void PrintTexCoords(const aiMesh *mesh);
+void PrintFaces(const aiMesh *mesh);
+void PrintNode(aiNode *node, const aiScene *scene);
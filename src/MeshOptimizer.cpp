@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "MeshOptimizer.hpp"
+
+struct VertexHash {
+  const MeshVertex *vertices;
+  size_t operator()(GLuint idx) const {
+    // FNV-1a over the packed vertex bytes
+    const unsigned char *bytes = (const unsigned char *)&vertices[idx];
+    size_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(MeshVertex); i++) {
+      hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+  }
+};
+
+struct VertexEqual {
+  const MeshVertex *vertices;
+  bool operator()(GLuint a, GLuint b) const {
+    return memcmp(&vertices[a], &vertices[b], sizeof(MeshVertex)) == 0;
+  }
+};
+
+GLuint WeldVertices(MeshVertex *vertices, GLuint num_vertices,
+                    GLuint *elements, GLuint num_elements) {
+  std::unordered_map<GLuint, GLuint, VertexHash, VertexEqual> unique(
+      num_vertices, VertexHash{vertices}, VertexEqual{vertices});
+  std::vector<GLuint> remap(num_vertices);
+  std::vector<bool> is_first(num_vertices, false);
+  GLuint num_unique = 0;
+  for (GLuint i = 0; i < num_vertices; i++) {
+    auto [it, inserted] = unique.emplace(i, num_unique);
+    is_first[i] = inserted;
+    remap[i] = inserted ? num_unique++ : it->second;
+  }
+  // unique vertices only ever move down, so compaction is safe in place
+  for (GLuint i = 0; i < num_vertices; i++) {
+    if (is_first[i] && remap[i] != i) {
+      vertices[remap[i]] = vertices[i];
+    }
+  }
+  for (GLuint i = 0; i < num_elements; i++) {
+    elements[i] = remap[elements[i]];
+  }
+  return num_unique;
+}
+
+void OptimizeVertexCache(GLuint *elements, GLuint num_elements,
+                         GLuint num_vertices,
+                         std::vector<GLuint> &cluster_offsets) {
+  const GLuint num_triangles = num_elements / 3;
+  cluster_offsets.clear();
+  if (num_triangles == 0) {
+    return;
+  }
+
+  // vertex -> triangle adjacency
+  std::vector<GLuint> live(num_vertices, 0);
+  for (GLuint i = 0; i < num_triangles * 3; i++) {
+    live[elements[i]]++;
+  }
+  std::vector<GLuint> adjacency_offsets(num_vertices + 1, 0);
+  for (GLuint v = 0; v < num_vertices; v++) {
+    adjacency_offsets[v + 1] = adjacency_offsets[v] + live[v];
+  }
+  std::vector<GLuint> adjacency(adjacency_offsets[num_vertices]);
+  std::vector<GLuint> fill(adjacency_offsets.begin(),
+                           adjacency_offsets.end() - 1);
+  for (GLuint t = 0; t < num_triangles; t++) {
+    for (GLuint k = 0; k < 3; k++) {
+      adjacency[fill[elements[t * 3 + k]]++] = t;
+    }
+  }
+
+  std::vector<GLuint> output;
+  output.reserve(num_triangles * 3);
+  std::vector<GLuint> cache_time(num_vertices, 0);
+  std::vector<bool> emitted(num_triangles, false);
+  std::vector<GLuint> dead_end;
+  std::vector<GLuint> candidates;
+  GLuint timestamp = kVertexCacheSize + 1;
+  GLuint cursor = 0;
+
+  auto SkipDeadEnd = [&]() -> int {
+    while (!dead_end.empty()) {
+      GLuint d = dead_end.back();
+      dead_end.pop_back();
+      if (live[d] > 0) {
+        return d;
+      }
+    }
+    while (cursor < num_vertices) {
+      if (live[cursor] > 0) {
+        return cursor;
+      }
+      cursor++;
+    }
+    return -1;
+  };
+
+  int fanning = SkipDeadEnd();
+  cluster_offsets.push_back(0);
+  while (fanning >= 0) {
+    candidates.clear();
+    for (GLuint a = adjacency_offsets[fanning];
+         a < adjacency_offsets[fanning + 1]; a++) {
+      GLuint t = adjacency[a];
+      if (emitted[t]) {
+        continue;
+      }
+      for (GLuint k = 0; k < 3; k++) {
+        GLuint v = elements[t * 3 + k];
+        output.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (timestamp - cache_time[v] > kVertexCacheSize) {
+          cache_time[v] = timestamp++;
+        }
+      }
+      emitted[t] = true;
+    }
+
+    // prefer the candidate that will still be in the cache when its
+    // remaining triangles are emitted, oldest first
+    int next = -1;
+    int best_priority = -1;
+    for (GLuint v : candidates) {
+      if (live[v] == 0) {
+        continue;
+      }
+      int priority = 0;
+      if (timestamp - cache_time[v] + 2 * live[v] <= kVertexCacheSize) {
+        priority = timestamp - cache_time[v];
+      }
+      if (priority > best_priority) {
+        best_priority = priority;
+        next = v;
+      }
+    }
+    if (next == -1) {
+      next = SkipDeadEnd();
+      if (next >= 0 && output.size() < num_triangles * 3) {
+        cluster_offsets.push_back(output.size());
+      }
+    }
+    fanning = next;
+  }
+  memcpy(elements, output.data(), output.size() * sizeof(GLuint));
+}
+
+void OptimizeOverdraw(GLuint *elements, GLuint num_elements,
+                      const MeshVertex *vertices,
+                      const std::vector<GLuint> &cluster_offsets) {
+  const GLuint num_clusters = cluster_offsets.size();
+  if (num_clusters < 2) {
+    return;
+  }
+  auto ClusterEnd = [&](GLuint c) -> GLuint {
+    return c + 1 < num_clusters ? cluster_offsets[c + 1] : num_elements;
+  };
+
+  // area-weighted centroid and normal per cluster and for the whole mesh
+  std::vector<glm::vec3> centroids(num_clusters, glm::vec3(0.0f));
+  std::vector<glm::vec3> normals(num_clusters, glm::vec3(0.0f));
+  glm::vec3 mesh_centroid{0.0f};
+  float mesh_area = 0.0f;
+  for (GLuint c = 0; c < num_clusters; c++) {
+    float cluster_area = 0.0f;
+    for (GLuint i = cluster_offsets[c]; i + 2 < ClusterEnd(c); i += 3) {
+      const glm::vec3 &p0 = vertices[elements[i]].position;
+      const glm::vec3 &p1 = vertices[elements[i + 1]].position;
+      const glm::vec3 &p2 = vertices[elements[i + 2]].position;
+      glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      float area = glm::length(normal);
+      centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+      normals[c] += normal;
+      cluster_area += area;
+    }
+    mesh_centroid += centroids[c];
+    mesh_area += cluster_area;
+    if (cluster_area > 0.0f) {
+      centroids[c] /= cluster_area;
+    }
+  }
+  if (mesh_area > 0.0f) {
+    mesh_centroid /= mesh_area;
+  }
+
+  std::vector<float> sort_keys(num_clusters);
+  std::vector<GLuint> order(num_clusters);
+  for (GLuint c = 0; c < num_clusters; c++) {
+    sort_keys[c] = glm::dot(centroids[c] - mesh_centroid, normals[c]);
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+    return sort_keys[a] > sort_keys[b];
+  });
+
+  std::vector<GLuint> output;
+  output.reserve(num_elements);
+  for (GLuint c : order) {
+    output.insert(output.end(), elements + cluster_offsets[c],
+                  elements + ClusterEnd(c));
+  }
+  memcpy(elements, output.data(), output.size() * sizeof(GLuint));
+}
+
+GLuint OptimizeVertexFetch(MeshVertex *vertices, GLuint num_vertices,
+                           GLuint *elements, GLuint num_elements) {
+  const GLuint kUnused = ~0u;
+  std::vector<GLuint> remap(num_vertices, kUnused);
+  GLuint next_vertex = 0;
+  for (GLuint i = 0; i < num_elements; i++) {
+    GLuint &slot = remap[elements[i]];
+    if (slot == kUnused) {
+      slot = next_vertex++;
+    }
+    elements[i] = slot;
+  }
+  std::vector<MeshVertex> reordered(next_vertex);
+  for (GLuint v = 0; v < num_vertices; v++) {
+    if (remap[v] != kUnused) {
+      reordered[remap[v]] = vertices[v];
+    }
+  }
+  memcpy(vertices, reordered.data(), next_vertex * sizeof(MeshVertex));
+  return next_vertex;
+}
+
+GLuint CountCacheMisses(const GLuint *elements, GLuint num_elements,
+                        GLuint num_vertices) {
+  // FIFO cache simulation, the model most hardware is closest to
+  std::vector<GLuint> cache_time(num_vertices, 0);
+  GLuint timestamp = kVertexCacheSize + 1;
+  GLuint misses = 0;
+  for (GLuint i = 0; i < num_elements; i++) {
+    GLuint v = elements[i];
+    if (timestamp - cache_time[v] > kVertexCacheSize) {
+      cache_time[v] = timestamp++;
+      misses++;
+    }
+  }
+  return misses;
+}
+
+GLuint OptimizeMesh(MeshVertex *vertices, GLuint num_vertices,
+                    GLuint *elements, GLuint num_elements,
+                    MeshOptimizeStats &stats) {
+  stats.num_vertices_before += num_vertices;
+  stats.num_triangles += num_elements / 3;
+  stats.cache_misses_before +=
+      CountCacheMisses(elements, num_elements, num_vertices);
+
+  std::vector<GLuint> cluster_offsets;
+  num_vertices = WeldVertices(vertices, num_vertices, elements, num_elements);
+  OptimizeVertexCache(elements, num_elements, num_vertices, cluster_offsets);
+  OptimizeOverdraw(elements, num_elements, vertices, cluster_offsets);
+  num_vertices =
+      OptimizeVertexFetch(vertices, num_vertices, elements, num_elements);
+
+  stats.num_vertices_after += num_vertices;
+  stats.cache_misses_after +=
+      CountCacheMisses(elements, num_elements, num_vertices);
+  return num_vertices;
+}
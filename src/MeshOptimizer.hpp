@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "Mesh.hpp"
+#include "gl.hpp"
+
+// Post-transform cache size the index order is tuned for and measured with.
+const GLuint kVertexCacheSize = 16;
+
+struct MeshOptimizeStats {
+  GLuint num_vertices_before{0};
+  GLuint num_vertices_after{0};
+  GLuint num_triangles{0};
+  GLuint cache_misses_before{0};
+  GLuint cache_misses_after{0};
+};
+
+// All passes operate in place on one mesh: `elements` index into `vertices`
+// starting at 0.
+
+// Merge bitwise identical vertices. Returns the new vertex count.
+GLuint WeldVertices(MeshVertex *vertices, GLuint num_vertices,
+                    GLuint *elements, GLuint num_elements);
+// Tipsify (Sander et al. 2007) triangle order for the post-transform cache.
+// Fills `cluster_offsets` with the element offset of every point where the
+// fan had to restart, which OptimizeOverdraw uses as reorder boundaries.
+void OptimizeVertexCache(GLuint *elements, GLuint num_elements,
+                         GLuint num_vertices,
+                         std::vector<GLuint> &cluster_offsets);
+// Sort clusters so outward-facing ones are drawn first.
+void OptimizeOverdraw(GLuint *elements, GLuint num_elements,
+                      const MeshVertex *vertices,
+                      const std::vector<GLuint> &cluster_offsets);
+// Renumber vertices in first-use order and drop unreferenced ones. Returns
+// the new vertex count.
+GLuint OptimizeVertexFetch(MeshVertex *vertices, GLuint num_vertices,
+                           GLuint *elements, GLuint num_elements);
+GLuint CountCacheMisses(const GLuint *elements, GLuint num_elements,
+                        GLuint num_vertices);
+// Runs every pass in order on one mesh and returns the new vertex count.
+GLuint OptimizeMesh(MeshVertex *vertices, GLuint num_vertices,
+                    GLuint *elements, GLuint num_elements,
+                    MeshOptimizeStats &stats);
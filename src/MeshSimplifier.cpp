@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "MeshSimplifier.hpp"
+
+// Boundary planes are weighted up so open edges keep their silhouette
+static const double kBorderWeight = 10.0;
+
+struct Quadric {
+  double a2, b2, c2, d2, ab, ac, ad, bc, bd, cd, weight;
+};
+
+static void AddPlane(Quadric &q, const glm::vec3 &normal, double d,
+                     double weight) {
+  double a = normal.x, b = normal.y, c = normal.z;
+  q.a2 += a * a * weight;
+  q.b2 += b * b * weight;
+  q.c2 += c * c * weight;
+  q.d2 += d * d * weight;
+  q.ab += a * b * weight;
+  q.ac += a * c * weight;
+  q.ad += a * d * weight;
+  q.bc += b * c * weight;
+  q.bd += b * d * weight;
+  q.cd += c * d * weight;
+  q.weight += weight;
+}
+
+static void AddQuadric(Quadric &q, const Quadric &other) {
+  q.a2 += other.a2;
+  q.b2 += other.b2;
+  q.c2 += other.c2;
+  q.d2 += other.d2;
+  q.ab += other.ab;
+  q.ac += other.ac;
+  q.ad += other.ad;
+  q.bc += other.bc;
+  q.bd += other.bd;
+  q.cd += other.cd;
+  q.weight += other.weight;
+}
+
+// weighted squared distance of `p` to the accumulated planes
+static double EvaluateQuadric(const Quadric &q, const glm::vec3 &p) {
+  double x = p.x, y = p.y, z = p.z;
+  double error = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2 +
+                 2.0 * (q.ab * x * y + q.ac * x * z + q.ad * x + q.bc * y * z +
+                        q.bd * y + q.cd * z);
+  return error < 0.0 ? 0.0 : error;
+}
+
+static uint64_t EdgeKey(GLuint a, GLuint b) {
+  if (a > b) {
+    std::swap(a, b);
+  }
+  return ((uint64_t)a << 32) | b;
+}
+
+struct PositionHash {
+  size_t operator()(const glm::vec3 &p) const {
+    uint32_t bits[3];
+    memcpy(bits, &p, sizeof(bits));
+    return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^
+           (bits[2] * 83492791u);
+  }
+};
+
+struct PositionEqual {
+  bool operator()(const glm::vec3 &a, const glm::vec3 &b) const {
+    return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+  }
+};
+
+struct Collapse {
+  GLuint from;
+  GLuint to;
+  double cost;
+};
+
+std::vector<GLuint> SimplifyMesh(const MeshVertex *vertices,
+                                 GLuint num_vertices, const GLuint *elements,
+                                 GLuint num_elements, GLuint target_elements,
+                                 float max_error, float &result_error) {
+  result_error = 0.0f;
+  std::vector<GLuint> indices(elements, elements + num_elements);
+  if (num_elements <= target_elements) {
+    return indices;
+  }
+
+  // Vertices that only differ in attributes (normal seams) share a position
+  // and collapse together; wedges are the vertices of one position.
+  std::unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual>
+      position_ids(num_vertices);
+  std::vector<GLuint> position_of(num_vertices);
+  std::vector<glm::vec3> positions;
+  for (GLuint v = 0; v < num_vertices; v++) {
+    auto [it, inserted] =
+        position_ids.emplace(vertices[v].position, positions.size());
+    if (inserted) {
+      positions.push_back(vertices[v].position);
+    }
+    position_of[v] = it->second;
+  }
+  const GLuint num_positions = positions.size();
+  std::vector<GLuint> wedge_offsets(num_positions + 1, 0);
+  for (GLuint v = 0; v < num_vertices; v++) {
+    wedge_offsets[position_of[v] + 1]++;
+  }
+  for (GLuint p = 0; p < num_positions; p++) {
+    wedge_offsets[p + 1] += wedge_offsets[p];
+  }
+  std::vector<GLuint> wedges(num_vertices);
+  {
+    std::vector<GLuint> fill(wedge_offsets.begin(), wedge_offsets.end() - 1);
+    for (GLuint v = 0; v < num_vertices; v++) {
+      wedges[fill[position_of[v]]++] = v;
+    }
+  }
+
+  auto TriangleNormal = [](const glm::vec3 &p0, const glm::vec3 &p1,
+                           const glm::vec3 &p2) {
+    return glm::cross(p1 - p0, p2 - p0);
+  };
+
+  // per-position quadrics from the face planes plus boundary planes
+  std::vector<Quadric> quadrics(num_positions, Quadric{});
+  std::unordered_map<uint64_t, GLuint> edge_counts;
+  for (GLuint i = 0; i + 2 < num_elements; i += 3) {
+    GLuint p[3] = {position_of[indices[i]], position_of[indices[i + 1]],
+                   position_of[indices[i + 2]]};
+    glm::vec3 normal =
+        TriangleNormal(positions[p[0]], positions[p[1]], positions[p[2]]);
+    float length = glm::length(normal);
+    if (length == 0.0f) {
+      continue;
+    }
+    normal /= length;
+    double d = -glm::dot(normal, positions[p[0]]);
+    for (GLuint k = 0; k < 3; k++) {
+      AddPlane(quadrics[p[k]], normal, d, length * 0.5);
+      edge_counts[EdgeKey(p[k], p[(k + 1) % 3])]++;
+    }
+  }
+  for (GLuint i = 0; i + 2 < num_elements; i += 3) {
+    GLuint p[3] = {position_of[indices[i]], position_of[indices[i + 1]],
+                   position_of[indices[i + 2]]};
+    glm::vec3 normal =
+        TriangleNormal(positions[p[0]], positions[p[1]], positions[p[2]]);
+    for (GLuint k = 0; k < 3; k++) {
+      GLuint a = p[k], b = p[(k + 1) % 3];
+      if (edge_counts[EdgeKey(a, b)] == 2) {
+        continue;
+      }
+      glm::vec3 edge = positions[b] - positions[a];
+      glm::vec3 border_normal = glm::cross(edge, normal);
+      float length = glm::length(border_normal);
+      if (length == 0.0f) {
+        continue;
+      }
+      border_normal /= length;
+      double d = -glm::dot(border_normal, positions[a]);
+      double weight = glm::dot(edge, edge) * kBorderWeight;
+      AddPlane(quadrics[a], border_normal, d, weight);
+      AddPlane(quadrics[b], border_normal, d, weight);
+    }
+  }
+
+  std::vector<GLuint> remap(num_positions);
+  std::vector<bool> touched(num_positions);
+  std::vector<bool> is_border(num_positions);
+  std::vector<GLuint> tri_offsets(num_positions + 1);
+  std::vector<GLuint> tris;
+  std::vector<Collapse> collapses;
+  double max_error_sq = (double)max_error * max_error;
+
+  while (indices.size() > target_elements) {
+    const GLuint num_triangles = indices.size() / 3;
+
+    // border status changes as the mesh shrinks, so rebuild it every pass
+    edge_counts.clear();
+    for (GLuint i = 0; i < indices.size(); i += 3) {
+      for (GLuint k = 0; k < 3; k++) {
+        edge_counts[EdgeKey(position_of[indices[i + k]],
+                            position_of[indices[i + (k + 1) % 3]])]++;
+      }
+    }
+    std::fill(is_border.begin(), is_border.end(), false);
+    for (const auto &[key, count] : edge_counts) {
+      if (count != 2) {
+        is_border[key >> 32] = true;
+        is_border[key & 0xffffffff] = true;
+      }
+    }
+
+    // position -> triangle adjacency
+    std::fill(tri_offsets.begin(), tri_offsets.end(), 0);
+    for (GLuint i = 0; i < indices.size(); i++) {
+      tri_offsets[position_of[indices[i]] + 1]++;
+    }
+    for (GLuint p = 0; p < num_positions; p++) {
+      tri_offsets[p + 1] += tri_offsets[p];
+    }
+    tris.resize(indices.size());
+    {
+      std::vector<GLuint> fill(tri_offsets.begin(), tri_offsets.end() - 1);
+      for (GLuint i = 0; i < indices.size(); i++) {
+        tris[fill[position_of[indices[i]]]++] = i / 3;
+      }
+    }
+
+    // collapse candidates, cheapest first
+    collapses.clear();
+    for (const auto &[key, count] : edge_counts) {
+      GLuint a = key >> 32;
+      GLuint b = key & 0xffffffff;
+      bool border_edge = count != 2;
+      for (int dir = 0; dir < 2; dir++) {
+        GLuint from = dir ? b : a;
+        GLuint to = dir ? a : b;
+        // a border vertex may only slide along the border
+        if (is_border[from] && !border_edge) {
+          continue;
+        }
+        Quadric q = quadrics[from];
+        AddQuadric(q, quadrics[to]);
+        double cost = EvaluateQuadric(q, positions[to]);
+        if (q.weight > 0.0) {
+          cost /= q.weight;
+        }
+        if (cost <= max_error_sq) {
+          collapses.push_back((Collapse){.from = from, .to = to, .cost = cost});
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &a, const Collapse &b) {
+                return a.cost < b.cost;
+              });
+
+    for (GLuint p = 0; p < num_positions; p++) {
+      remap[p] = p;
+    }
+    std::fill(touched.begin(), touched.end(), false);
+    GLuint triangles_left = num_triangles;
+    GLuint target_triangles = target_elements / 3;
+    GLuint applied = 0;
+    for (const Collapse &collapse : collapses) {
+      if (triangles_left <= target_triangles) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+      // reject collapses that would flip a surviving triangle
+      bool flips = false;
+      GLuint removed = 0;
+      for (GLuint a = tri_offsets[collapse.from];
+           a < tri_offsets[collapse.from + 1] && !flips; a++) {
+        GLuint t = tris[a];
+        GLuint p[3] = {position_of[indices[t * 3]],
+                       position_of[indices[t * 3 + 1]],
+                       position_of[indices[t * 3 + 2]]};
+        if (p[0] == collapse.to || p[1] == collapse.to ||
+            p[2] == collapse.to) {
+          removed++;
+          continue;
+        }
+        glm::vec3 before =
+            TriangleNormal(positions[p[0]], positions[p[1]], positions[p[2]]);
+        for (GLuint k = 0; k < 3; k++) {
+          if (p[k] == collapse.from) {
+            p[k] = collapse.to;
+          }
+        }
+        glm::vec3 after =
+            TriangleNormal(positions[p[0]], positions[p[1]], positions[p[2]]);
+        // also reject turning by more than ~75 degrees, which folds slivers
+        // onto borders
+        flips = glm::dot(before, after) <=
+                0.25f * glm::length(before) * glm::length(after);
+      }
+      if (flips) {
+        continue;
+      }
+      remap[collapse.from] = collapse.to;
+      AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+      // lock the whole one-ring so flip checks stay valid this pass
+      for (GLuint a = tri_offsets[collapse.from];
+           a < tri_offsets[collapse.from + 1]; a++) {
+        GLuint t = tris[a];
+        for (GLuint k = 0; k < 3; k++) {
+          touched[position_of[indices[t * 3 + k]]] = true;
+        }
+      }
+      triangles_left -= std::min(removed, triangles_left);
+      result_error =
+          std::max(result_error, (float)std::sqrt(collapse.cost));
+      applied++;
+    }
+    if (applied == 0) {
+      break;
+    }
+
+    // rewrite corners onto the wedge of the target position whose normal is
+    // closest, so attribute seams survive
+    std::vector<GLuint> simplified;
+    simplified.reserve(indices.size());
+    for (GLuint i = 0; i < indices.size(); i += 3) {
+      GLuint tri[3] = {indices[i], indices[i + 1], indices[i + 2]};
+      GLuint p[3];
+      for (GLuint k = 0; k < 3; k++) {
+        p[k] = remap[position_of[tri[k]]];
+      }
+      if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) {
+        continue;
+      }
+      for (GLuint k = 0; k < 3; k++) {
+        if (position_of[tri[k]] == p[k]) {
+          continue;
+        }
+        GLuint best = wedges[wedge_offsets[p[k]]];
+        float best_dot = -2.0f;
+        for (GLuint w = wedge_offsets[p[k]]; w < wedge_offsets[p[k] + 1];
+             w++) {
+          float d = glm::dot(vertices[wedges[w]].normal,
+                             vertices[tri[k]].normal);
+          if (d > best_dot) {
+            best_dot = d;
+            best = wedges[w];
+          }
+        }
+        tri[k] = best;
+      }
+      simplified.insert(simplified.end(), tri, tri + 3);
+    }
+    indices.swap(simplified);
+  }
+  return indices;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+
+#include "Mesh.hpp"
+#include "gl.hpp"
+
+// Quadric error edge-collapse simplification (Garland & Heckbert 1997).
+// Vertices are never moved, only collapsed onto a neighbour, so every LOD
+// indexes the original vertex buffer. Stops at `target_elements` or when no
+// collapse below `max_error` is left. `result_error` receives the largest
+// collapse error in object-space units.
+std::vector<GLuint> SimplifyMesh(const MeshVertex *vertices,
+                                 GLuint num_vertices, const GLuint *elements,
+                                 GLuint num_elements, GLuint target_elements,
+                                 float max_error, float &result_error);
@@ -0,0 +1,155 @@
+#include "ModelLoader.hpp"
+#include <algorithm>
+#include <iostream>
+
+ModelLoader::ModelLoader() : m_worker{&ModelLoader::Work, this} {};
+
+ModelLoader::~ModelLoader() {
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_is_stopping = true;
+  }
+  m_condition.notify_one();
+  m_worker.join();
+};
+
+void ModelLoader::Work() {
+  std::unique_lock<std::mutex> lock{m_mutex};
+  while (true) {
+    m_condition.wait(
+        lock, [this]() { return m_is_stopping || !m_requests.empty(); });
+    if (m_is_stopping) {
+      return;
+    }
+    ImportRequest request{std::move(m_requests.front())};
+    m_requests.pop_front();
+    lock.unlock();
+    MeshCache cache{ImportCached(request.path)};
+    lock.lock();
+    m_results.push_back(
+        (ImportResult){.handle = request.handle, .cache = std::move(cache)});
+  }
+};
+
+void ModelLoader::Queue(ModelHandle handle, const std::string &path) {
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_requests.push_back((ImportRequest){.handle = handle, .path = path});
+  }
+  m_condition.notify_one();
+  m_num_importing++;
+};
+
+ModelHandle ModelLoader::Load(const std::string &p_file) {
+  ModelHandle handle = m_next_handle++;
+  m_paths[handle] = p_file;
+  m_watcher.Watch(p_file);
+  Queue(handle, p_file);
+  return handle;
+};
+
+void ModelLoader::Reload(Model &model, ImportResult &result,
+                         MaterialTable &materials) {
+  const std::string &path = m_paths[result.handle];
+  MeshBuffers buffers{result.cache.GetBuffers()};
+  // most likely caught halfway through being written
+  if (buffers.num_meshes == 0) {
+    std::cerr << "Reloaded model is empty, keeping the old one: " << path
+              << std::endl;
+    return;
+  }
+  GLsizeiptr num_bytes =
+      model.rp_material.Reload(model.cache.GetBuffers(), buffers, materials);
+  model.transforms = TransformHierarchy{buffers.nodes, buffers.num_nodes};
+  model.transforms.Update();
+  model.rp_material.SetNodeMatrices(model.transforms.GetWorldMatrices());
+  model.cache = std::move(result.cache);
+  std::cout << "Reloaded model: " << path << " (" << num_bytes
+            << " bytes uploaded)" << std::endl;
+};
+
+void ModelLoader::Update(MaterialTable &materials, GLsizeiptr max_bytes) {
+  std::vector<std::string> changed_paths{m_watcher.Poll()};
+  for (const auto &[handle, path] : m_paths) {
+    const std::vector<std::string> &dependencies = m_dependencies[handle];
+    bool is_changed = std::any_of(
+        changed_paths.begin(), changed_paths.end(),
+        [&](const std::string &changed_path) {
+          return changed_path == path ||
+                 std::find(dependencies.begin(), dependencies.end(),
+                           changed_path) != dependencies.end();
+        });
+    if (is_changed) {
+      Queue(handle, path);
+    }
+  }
+
+  std::vector<ImportResult> results{};
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    results.swap(m_results);
+  }
+  for (ImportResult &result : results) {
+    m_num_importing--;
+    if (!result.cache.IsValid()) {
+      std::cerr << "Could not load model " << result.handle << std::endl;
+      continue;
+    }
+    // a reimport may name other material libraries
+    m_dependencies[result.handle] = result.cache.GetDependencies();
+    for (const std::string &dependency : m_dependencies[result.handle]) {
+      m_watcher.Watch(dependency);
+    }
+    // vertices address the table with 16-bit indices
+    MeshBuffers buffers{result.cache.GetBuffers()};
+    if (!materials.CanAddGroup(buffers.materials, buffers.num_materials,
+                               kMaxVertexMaterials)) {
+      std::cerr << "Material table is full, could not load model "
+                << result.handle << std::endl;
+      continue;
+    }
+    auto model = m_models.find(result.handle);
+    if (model != m_models.end()) {
+      Reload(model->second, result, materials);
+      continue;
+    }
+    // changed again before it finished uploading, start over
+    auto upload = std::find_if(
+        m_uploads.begin(), m_uploads.end(),
+        [&](const Upload &upload) { return upload.handle == result.handle; });
+    if (upload != m_uploads.end()) {
+      m_uploads.erase(upload);
+    }
+    m_uploads.push_back(
+        (Upload){.handle = result.handle,
+                 .cache = std::move(result.cache),
+                 .rp_material = RPMaterial{buffers, materials, true}});
+  }
+
+  // oldest first, so models finish one after another rather than all late
+  while (!m_uploads.empty() && max_bytes > 0) {
+    Upload &upload = m_uploads.front();
+    MeshBuffers buffers{upload.cache.GetBuffers()};
+    max_bytes -= upload.rp_material.UploadBuffers(buffers, max_bytes);
+    if (!upload.rp_material.IsUploaded()) {
+      break;
+    }
+    TransformHierarchy transforms{buffers.nodes, buffers.num_nodes};
+    transforms.Update();
+    upload.rp_material.SetNodeMatrices(transforms.GetWorldMatrices());
+    m_models.emplace(upload.handle,
+                     (Model){.rp_material = std::move(upload.rp_material),
+                             .transforms = std::move(transforms),
+                             .cache = std::move(upload.cache)});
+    m_uploads.pop_front();
+  }
+};
+
+Model *ModelLoader::Get(ModelHandle handle) {
+  auto it = m_models.find(handle);
+  return it != m_models.end() ? &it->second : nullptr;
+};
+
+GLuint ModelLoader::GetNumLoading() const {
+  return m_num_importing + m_uploads.size();
+};
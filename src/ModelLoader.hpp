@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "FileWatcher.hpp"
+#include "MeshCache.hpp"
+#include "RenderPass.hpp"
+#include "TransformHierarchy.hpp"
+
+typedef GLuint ModelHandle;
+
+// A model whose buffers are all on the GPU
+struct Model {
+  RPMaterial rp_material;
+  TransformHierarchy transforms;
+  // what rp_material was built from, diffed against on reload
+  MeshCache cache;
+};
+
+// Loads models without stalling the frame. ImportCached runs on a worker
+// thread; the GL thread then streams each result to the GPU in pieces of a
+// fixed byte budget per frame, so a large model takes a few frames to
+// appear instead of one long one.
+// Loaded files and the files their import read, like material libraries,
+// are watched; a model whose files change is re-imported and its GPU
+// buffers are patched with only what differs.
+class ModelLoader {
+public:
+  ModelLoader();
+  ~ModelLoader();
+  NEVER_COPY(ModelLoader);
+  // Queues p_file for import; the handle is usable right away
+  ModelHandle Load(const std::string &p_file);
+  // GL thread, once per frame. Starts uploading imports the worker
+  // finished, adding their materials to materials, and uploads at most
+  // max_bytes of buffer data in total.
+  void Update(MaterialTable &materials, GLsizeiptr max_bytes);
+  // nullptr until the model is fully uploaded. Stays valid until the
+  // ModelLoader is destroyed; reloads update the model in place.
+  Model *Get(ModelHandle handle);
+  // Models queued, importing or uploading
+  GLuint GetNumLoading() const;
+
+private:
+  struct ImportRequest {
+    ModelHandle handle;
+    std::string path;
+  };
+  struct ImportResult {
+    ModelHandle handle;
+    MeshCache cache;
+  };
+  // An imported model whose RPMaterial is being filled
+  struct Upload {
+    ModelHandle handle;
+    MeshCache cache;
+    RPMaterial rp_material;
+  };
+  void Work();
+  void Queue(ModelHandle handle, const std::string &path);
+  void Reload(Model &model, ImportResult &result, MaterialTable &materials);
+
+  // shared with the worker, guarded by m_mutex
+  std::mutex m_mutex{};
+  std::condition_variable m_condition{};
+  std::deque<ImportRequest> m_requests{};
+  std::vector<ImportResult> m_results{};
+  bool m_is_stopping{false};
+  std::thread m_worker{};
+
+  // GL thread only
+  ModelHandle m_next_handle{0};
+  GLuint m_num_importing{0};
+  std::list<Upload> m_uploads{};
+  std::unordered_map<ModelHandle, Model> m_models{};
+  std::unordered_map<ModelHandle, std::string> m_paths{};
+  // see MeshCache::GetDependencies, as of the last import
+  std::unordered_map<ModelHandle, std::vector<std::string>> m_dependencies{};
+  FileWatcher m_watcher{};
+};
@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "ObjLoader.hpp"
+#include "utils.hpp"
+
+// Chunks are small enough to balance across threads, large enough that the
+// per-chunk bookkeeping does not matter.
+static const size_t kMinChunkSize = 1 << 16;
+static const GLuint kChunksPerThread = 4;
+static const GLuint kNoMaterial = 0xffffffff;
+
+// assimp's defaults, so both importers agree on sparse MTL files
+static const BSDFMaterial kDefaultMaterial{
+    .ambient_color = glm::vec3(0.0f),
+    .diffuse_color = glm::vec3(0.6f),
+    .specular_color = glm::vec3(0.0f),
+    .shininess = 0.0f};
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope
+class FileMapping {
+public:
+  FileMapping(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return;
+    }
+    void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      return;
+    }
+    m_data = (const char *)mapping;
+    m_size = st.st_size;
+  };
+  ~FileMapping() {
+    if (m_data != nullptr) {
+      munmap((void *)m_data, m_size);
+    }
+  };
+  NEVER_COPY(FileMapping);
+  bool IsValid() const { return m_data != nullptr; };
+  const char *GetBegin() const { return m_data; };
+  const char *GetEnd() const { return m_data + m_size; };
+  size_t GetSize() const { return m_size; };
+
+private:
+  const char *m_data{nullptr};
+  size_t m_size{0};
+};
+
+// usemtl, o or g at a corner of the chunk: corners before it use the
+// previous state
+struct ObjStateChange {
+  GLuint corner;
+  bool is_object;
+  std::string_view name;
+};
+
+struct ObjChunk {
+  const char *begin;
+  const char *end;
+  GLuint num_positions{0};
+  GLuint num_normals{0};
+  // global index of the chunk's first v and vn
+  GLuint position_offset{0};
+  GLuint normal_offset{0};
+  std::vector<MeshCorner> corners{};
+  std::vector<ObjStateChange> changes{};
+  std::vector<std::string_view> libraries{};
+  bool is_valid{true};
+};
+
+static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+static const char *SkipSpaces(const char *p, const char *end) {
+  while (p < end && IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *FindLineEnd(const char *p, const char *end) {
+  const char *newline = (const char *)memchr(p, '\n', end - p);
+  return newline != nullptr ? newline : end;
+}
+
+// Splits a line into its keyword and the rest after it
+static std::string_view ParseKeyword(const char *&p, const char *end) {
+  p = SkipSpaces(p, end);
+  const char *keyword = p;
+  while (p < end && !IsSpace(*p)) {
+    p++;
+  }
+  return std::string_view(keyword, p - keyword);
+}
+
+// Rest of the line without surrounding whitespace; names may contain spaces
+static std::string_view ParseName(const char *p, const char *end) {
+  p = SkipSpaces(p, end);
+  while (end > p && IsSpace(end[-1])) {
+    end--;
+  }
+  return std::string_view(p, end - p);
+}
+
+static const double kPowersOf10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                     1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                     1e18, 1e19, 1e20, 1e21, 1e22};
+
+// [-+]digits[.digits][(e|E)[-+]digits] without locale or allocation, like
+// std::from_chars. Up to 19 significant digits are accumulated exactly and
+// scaled by one exact power of ten, which is well within float precision.
+// Stops at the first character that does not fit the pattern.
+static const char *ParseFloat(const char *p, const char *end, float &value) {
+  p = SkipSpaces(p, end);
+  bool is_negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    is_negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  int num_digits = 0;
+  for (; p < end && IsDigit(*p); p++) {
+    if (num_digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      num_digits += mantissa != 0;
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && IsDigit(*p); p++) {
+      if (num_digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        num_digits += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool is_exponent_negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      is_exponent_negative = *p == '-';
+      p++;
+    }
+    int written_exponent = 0;
+    for (; p < end && IsDigit(*p); p++) {
+      written_exponent = std::min(written_exponent * 10 + (*p - '0'), 9999);
+    }
+    exponent += is_exponent_negative ? -written_exponent : written_exponent;
+  }
+  double result = (double)mantissa;
+  if (mantissa != 0) {
+    for (; exponent > 22; exponent -= 22) {
+      result *= kPowersOf10[22];
+    }
+    for (; exponent < -22; exponent += 22) {
+      result /= kPowersOf10[22];
+    }
+    result = exponent < 0 ? result / kPowersOf10[-exponent]
+                          : result * kPowersOf10[exponent];
+  }
+  value = (float)(is_negative ? -result : result);
+  return p;
+}
+
+static bool ParseInt(const char *&p, const char *end, int64_t &value) {
+  bool is_negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  if (p == end || !IsDigit(*p)) {
+    return false;
+  }
+  value = 0;
+  for (; p < end && IsDigit(*p); p++) {
+    value = std::min<int64_t>(value * 10 + (*p - '0'), 0xffffffffll);
+  }
+  value = is_negative ? -value : value;
+  return true;
+}
+
+// OBJ indices are 1-based, or negative to count back from the last element
+// defined so far
+static bool ResolveIndex(int64_t index, GLuint count, GLuint &resolved) {
+  if (index > 0 && index <= count) {
+    resolved = index - 1;
+    return true;
+  }
+  if (index < 0 && -index <= count) {
+    resolved = count + index;
+    return true;
+  }
+  return false;
+}
+
+// v, v/vt, v//vn or v/vt/vn corners; polygons are triangulated as a fan
+static bool ParseFace(const char *p, const char *end, GLuint num_positions,
+                      GLuint num_normals, std::vector<MeshCorner> &corners) {
+  MeshCorner first{};
+  MeshCorner previous{};
+  GLuint num_face_corners = 0;
+  for (p = SkipSpaces(p, end); p < end; p = SkipSpaces(p, end)) {
+    MeshCorner corner{.position = 0, .normal = kNoNormal};
+    int64_t index = 0;
+    if (!ParseInt(p, end, index) ||
+        !ResolveIndex(index, num_positions, corner.position)) {
+      return false;
+    }
+    if (p < end && *p == '/') {
+      p++;
+      if (p < end && *p != '/' && !ParseInt(p, end, index)) {
+        return false;
+      }
+      if (p < end && *p == '/') {
+        p++;
+        if (!ParseInt(p, end, index) ||
+            !ResolveIndex(index, num_normals, corner.normal)) {
+          return false;
+        }
+      }
+    }
+    if (p < end && !IsSpace(*p)) {
+      return false;
+    }
+    if (num_face_corners == 0) {
+      first = corner;
+    }
+    if (num_face_corners >= 2) {
+      corners.insert(corners.end(), {first, previous, corner});
+    }
+    previous = corner;
+    num_face_corners++;
+  }
+  return num_face_corners >= 3;
+}
+
+// First pass: only v and vn are counted, so every chunk knows where its
+// vertices go and what relative indices refer to before parsing
+static void CountChunk(ObjChunk &chunk) {
+  for (const char *p = chunk.begin; p < chunk.end;) {
+    const char *line_end = FindLineEnd(p, chunk.end);
+    std::string_view keyword = ParseKeyword(p, line_end);
+    chunk.num_positions += keyword == "v";
+    chunk.num_normals += keyword == "vn";
+    p = line_end + 1;
+  }
+}
+
+static void ParseChunk(ObjChunk &chunk, ObjModel &model) {
+  GLuint num_positions = chunk.position_offset;
+  GLuint num_normals = chunk.normal_offset;
+  for (const char *p = chunk.begin; p < chunk.end && chunk.is_valid;) {
+    const char *line_end = FindLineEnd(p, chunk.end);
+    std::string_view keyword = ParseKeyword(p, line_end);
+    if (keyword == "v") {
+      glm::vec3 &position = model.positions[num_positions++];
+      p = ParseFloat(p, line_end, position.x);
+      p = ParseFloat(p, line_end, position.y);
+      ParseFloat(p, line_end, position.z);
+    } else if (keyword == "vn") {
+      glm::vec3 &normal = model.normals[num_normals++];
+      p = ParseFloat(p, line_end, normal.x);
+      p = ParseFloat(p, line_end, normal.y);
+      ParseFloat(p, line_end, normal.z);
+    } else if (keyword == "f") {
+      chunk.is_valid = ParseFace(p, line_end, num_positions, num_normals,
+                                 chunk.corners);
+    } else if (keyword == "usemtl" || keyword == "o" || keyword == "g") {
+      chunk.changes.push_back((ObjStateChange){
+          .corner = (GLuint)chunk.corners.size(),
+          .is_object = keyword != "usemtl",
+          .name = ParseName(p, line_end)});
+    } else if (keyword == "mtllib") {
+      chunk.libraries.push_back(ParseName(p, line_end));
+    }
+    p = line_end + 1;
+  }
+}
+
+static void LoadMtl(const std::string &path,
+                    std::vector<BSDFMaterial> &materials,
+                    std::unordered_map<std::string, GLuint> &material_indices) {
+  FileMapping mapping{path};
+  if (!mapping.IsValid()) {
+    std::cerr << "Could not open material library: " << path << std::endl;
+    return;
+  }
+  BSDFMaterial *material = nullptr;
+  for (const char *p = mapping.GetBegin(); p < mapping.GetEnd();) {
+    const char *line_end = FindLineEnd(p, mapping.GetEnd());
+    std::string_view keyword = ParseKeyword(p, line_end);
+    if (keyword == "newmtl") {
+      material_indices[std::string(ParseName(p, line_end))] = materials.size();
+      materials.push_back(kDefaultMaterial);
+      material = &materials.back();
+    } else if (material != nullptr && (keyword == "Ka" || keyword == "Kd" ||
+                                       keyword == "Ks")) {
+      glm::vec3 &color = keyword == "Ka"   ? material->ambient_color
+                         : keyword == "Kd" ? material->diffuse_color
+                                           : material->specular_color;
+      p = ParseFloat(p, line_end, color.x);
+      p = ParseFloat(p, line_end, color.y);
+      ParseFloat(p, line_end, color.z);
+    } else if (material != nullptr && keyword == "Ns") {
+      ParseFloat(p, line_end, material->shininess);
+    }
+    p = line_end + 1;
+  }
+}
+
+bool LoadObj(const std::string &path, ObjModel &model) {
+  FileMapping mapping{path};
+  if (!mapping.IsValid()) {
+    std::cerr << "Could not open OBJ file: " << path << std::endl;
+    return false;
+  }
+
+  // Line-aligned chunks
+  GLuint max_chunks =
+      kChunksPerThread * std::max(1u, std::thread::hardware_concurrency());
+  GLuint num_chunks = std::clamp<size_t>(mapping.GetSize() / kMinChunkSize,
+                                         1, max_chunks);
+  std::vector<ObjChunk> chunks(num_chunks);
+  const char *chunk_begin = mapping.GetBegin();
+  for (GLuint i = 0; i < num_chunks; i++) {
+    const char *chunk_end = mapping.GetEnd();
+    if (i + 1 < num_chunks) {
+      chunk_end = mapping.GetBegin() + mapping.GetSize() * (i + 1) / num_chunks;
+      chunk_end = std::max(chunk_begin, chunk_end);
+      chunk_end = std::min(FindLineEnd(chunk_end, mapping.GetEnd()) + 1,
+                           mapping.GetEnd());
+    }
+    chunks[i].begin = chunk_begin;
+    chunks[i].end = chunk_end;
+    chunk_begin = chunk_end;
+  }
+
+  // Count, place and parse every chunk
+  ParallelFor(num_chunks, [&](uint i) { CountChunk(chunks[i]); });
+  GLuint num_positions = 0;
+  GLuint num_normals = 0;
+  for (ObjChunk &chunk : chunks) {
+    chunk.position_offset = num_positions;
+    chunk.normal_offset = num_normals;
+    num_positions += chunk.num_positions;
+    num_normals += chunk.num_normals;
+  }
+  model.positions.resize(num_positions);
+  model.normals.resize(num_normals);
+  ParallelFor(num_chunks, [&](uint i) { ParseChunk(chunks[i], model); });
+  for (const ObjChunk &chunk : chunks) {
+    if (!chunk.is_valid) {
+      std::cerr << "Malformed face in OBJ file: " << path << std::endl;
+      return false;
+    }
+  }
+
+  std::unordered_map<std::string, GLuint> material_indices{};
+  std::filesystem::path directory = std::filesystem::path(path).parent_path();
+  for (const ObjChunk &chunk : chunks) {
+    for (std::string_view library : chunk.libraries) {
+      std::string library_path = (directory / library).string();
+      if (std::find(model.material_libraries.begin(),
+                    model.material_libraries.end(),
+                    library_path) != model.material_libraries.end()) {
+        continue;
+      }
+      model.material_libraries.push_back(library_path);
+      LoadMtl(library_path, model.materials, material_indices);
+    }
+  }
+
+  // Replay the usemtl/o/g state in file order and sort corner ranges into
+  // one mesh per object and material
+  struct CornerRange {
+    GLuint chunk_idx;
+    GLuint begin;
+    GLuint end;
+  };
+  std::map<std::pair<GLuint, GLuint>, GLuint> mesh_indices{};
+  std::vector<std::vector<CornerRange>> mesh_ranges{};
+  GLuint object_idx = 0;
+  bool object_has_faces = false;
+  GLuint material_idx = kNoMaterial;
+  GLuint default_material_idx = kNoMaterial;
+  model.num_objects = 1;
+  auto AddRange = [&](GLuint chunk_idx, GLuint begin, GLuint end) {
+    if (begin == end) {
+      return;
+    }
+    if (material_idx == kNoMaterial) {
+      if (default_material_idx == kNoMaterial) {
+        default_material_idx = model.materials.size();
+        model.materials.push_back(kDefaultMaterial);
+      }
+      material_idx = default_material_idx;
+    }
+    auto [it, inserted] = mesh_indices.emplace(
+        std::make_pair(object_idx, material_idx), mesh_ranges.size());
+    if (inserted) {
+      mesh_ranges.emplace_back();
+      model.meshes.push_back(
+          (ObjMesh){.material_idx = material_idx, .object_idx = object_idx});
+    }
+    mesh_ranges[it->second].push_back(
+        (CornerRange){.chunk_idx = chunk_idx, .begin = begin, .end = end});
+    object_has_faces = true;
+  };
+  for (GLuint chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++) {
+    const ObjChunk &chunk = chunks[chunk_idx];
+    GLuint begin = 0;
+    for (const ObjStateChange &change : chunk.changes) {
+      AddRange(chunk_idx, begin, change.corner);
+      begin = change.corner;
+      if (change.is_object) {
+        // an object without faces is renamed rather than kept empty
+        if (object_has_faces) {
+          object_idx = model.num_objects++;
+          object_has_faces = false;
+        }
+        continue;
+      }
+      auto it = material_indices.find(std::string(change.name));
+      if (it == material_indices.end()) {
+        std::cerr << "Unknown material in OBJ file: " << change.name
+                  << std::endl;
+        material_idx = kNoMaterial;
+      } else {
+        material_idx = it->second;
+      }
+    }
+    AddRange(chunk_idx, begin, chunk.corners.size());
+  }
+
+  ParallelFor(model.meshes.size(), [&](uint mesh_idx) {
+    std::vector<MeshCorner> &corners = model.meshes[mesh_idx].corners;
+    size_t num_corners = 0;
+    for (const CornerRange &range : mesh_ranges[mesh_idx]) {
+      num_corners += range.end - range.begin;
+    }
+    corners.reserve(num_corners);
+    for (const CornerRange &range : mesh_ranges[mesh_idx]) {
+      const std::vector<MeshCorner> &source = chunks[range.chunk_idx].corners;
+      corners.insert(corners.end(), source.begin() + range.begin,
+                     source.begin() + range.end);
+    }
+  });
+  return true;
+}
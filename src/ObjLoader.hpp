@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "Material.hpp"
+#include "Mesh.hpp"
+
+// The faces of one object drawn with one material, triangulated
+struct ObjMesh {
+  GLuint material_idx;
+  // 'o'/'g' object the faces belong to, 0 for faces before the first one
+  GLuint object_idx;
+  std::vector<MeshCorner> corners;
+};
+
+struct ObjModel {
+  std::vector<BSDFMaterial> materials;
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  GLuint num_objects;
+  // in order of first appearance in the file
+  std::vector<ObjMesh> meshes;
+  // every mtllib the file names, including ones that could not be read
+  std::vector<std::string> material_libraries;
+};
+
+// Wavefront OBJ/MTL reader for the subset our assets use: v, vn, f,
+// usemtl, mtllib, o and g. The file is mapped and parsed in line-aligned
+// chunks on all threads. Polygons are fan-triangulated and texture
+// coordinates are ignored. Returns false if the file cannot be read or has
+// a malformed face.
+bool LoadObj(const std::string &path, ObjModel &model);
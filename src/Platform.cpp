@@ -1,5 +1,6 @@
 #include <iostream>
 
+#include "GLState.hpp"
 #include "Platform.hpp"
 #include "gl.hpp"
 
@@ -60,7 +61,7 @@ void Platform::Loop(Game &game) {
     }
     game.Render();
     EndImguiFrame();
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    GetGLState().BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
     SDL_GL_SwapWindow(m_window);
   }
 }
@@ -79,6 +80,8 @@ void Platform::BeginImguiFrame() {
 void Platform::EndImguiFrame() {
   ImGui::Render();
   ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+  // the backend sets GL state directly
+  GetGLState().Invalidate();
 }
 
 void Platform::InitGL(int width, int height) {
@@ -0,0 +1,117 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "ProgramCache.hpp"
+#include "utils.hpp"
+
+static const char kProgramCacheMagic[4] = {'B', 'P', 'R', 'G'};
+static const uint32_t kProgramCacheVersion = 1;
+static const char *kProgramCacheDir = "shaders/cache";
+
+struct ProgramCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t binary_format;
+  uint32_t binary_size;
+};
+
+static std::string GetProgramCachePath(uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.programcache",
+           (unsigned long long)key);
+  return (std::filesystem::path(kProgramCacheDir) / name).string();
+}
+
+// Drivers without any binary format cannot use the cache at all
+static bool HasProgramBinaryFormats() {
+  static GLint num_formats = -1;
+  if (num_formats < 0) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+  }
+  return num_formats > 0;
+}
+
+uint64_t GetProgramCacheKey(const std::vector<uint64_t> &source_hashes) {
+  uint64_t key = kSourceHashSeed;
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const char *value = (const char *)glGetString(name);
+    key = HashSource(value != nullptr ? value : "", key);
+    key = HashSource(std::string_view{"\0", 1}, key);
+  }
+  for (uint64_t source_hash : source_hashes) {
+    key = HashSource(
+        std::string_view{(const char *)&source_hash, sizeof(source_hash)}, key);
+  }
+  return key;
+}
+
+bool LoadProgramBinary(GLuint program, uint64_t key) {
+  if (!HasProgramBinaryFormats()) {
+    return false;
+  }
+  std::ifstream file_stream(GetProgramCachePath(key), std::ios::binary);
+  if (!file_stream.is_open()) {
+    return false;
+  }
+  ProgramCacheHeader header{};
+  file_stream.read((char *)&header, sizeof(header));
+  if (!file_stream.good() ||
+      memcmp(header.magic, kProgramCacheMagic, sizeof(kProgramCacheMagic)) !=
+          0 ||
+      header.version != kProgramCacheVersion || header.key != key) {
+    return false;
+  }
+  std::vector<char> binary(header.binary_size);
+  file_stream.read(binary.data(), binary.size());
+  if (!file_stream.good()) {
+    return false;
+  }
+  // a driver update may still refuse an old binary
+  glProgramBinary(program, header.binary_format, binary.data(),
+                  binary.size());
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  return success == GL_TRUE;
+}
+
+void SaveProgramBinary(GLuint program, uint64_t key) {
+  if (!HasProgramBinaryFormats()) {
+    return;
+  }
+  GLint binary_size = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+  if (binary_size <= 0) {
+    return;
+  }
+  std::vector<char> binary(binary_size);
+  GLenum binary_format = 0;
+  glGetProgramBinary(program, binary_size, nullptr, &binary_format,
+                     binary.data());
+
+  ProgramCacheHeader header{};
+  memcpy(header.magic, kProgramCacheMagic, sizeof(kProgramCacheMagic));
+  header.version = kProgramCacheVersion;
+  header.key = key;
+  header.binary_format = binary_format;
+  header.binary_size = binary_size;
+
+  std::error_code ec;
+  std::filesystem::create_directories(kProgramCacheDir, ec);
+  // write to a temporary and rename so a crash never leaves a torn binary
+  const std::string cache_path = GetProgramCachePath(key);
+  const std::string tmp_path = cache_path + ".tmp";
+  {
+    std::ofstream file_stream(tmp_path, std::ios::binary | std::ios::trunc);
+    file_stream.write((const char *)&header, sizeof(header));
+    file_stream.write(binary.data(), binary.size());
+    if (!file_stream.good()) {
+      std::cerr << "Could not write program cache: " << cache_path
+                << std::endl;
+      return;
+    }
+  }
+  std::filesystem::rename(tmp_path, cache_path, ec);
+}
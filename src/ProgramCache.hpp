@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "gl.hpp"
+
+// On-disk cache of linked program binaries, so later launches skip GLSL
+// compilation. Entries are keyed by the hashes of the preprocessed sources
+// of every stage and the driver's vendor, renderer and version strings,
+// since a binary is only valid for the driver that produced it.
+uint64_t GetProgramCacheKey(const std::vector<uint64_t> &source_hashes);
+// Links program from the cached binary. False if there is none or the
+// driver rejected it; program can then be compiled as usual.
+bool LoadProgramBinary(GLuint program, uint64_t key);
+// For programs linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+void SaveProgramBinary(GLuint program, uint64_t key);
@@ -0,0 +1,61 @@
+#include "RenderPass.hpp"
+
+// must match local_size_x in shaders/cull_compute.glsl
+static const GLuint kCullGroupSize = 64;
+
+static constexpr Uniform<GLuint> kUniformNumMeshes{"uNumMeshes"};
+static constexpr Uniform<GLuint> kUniformNumBuckets{"uNumBuckets"};
+static constexpr Uniform<glm::vec4> kUniformFrustumPlanes{"uFrustumPlanes"};
+static constexpr Uniform<glm::mat4> kUniformModelMatrix{"uModelMatrix"};
+static constexpr Uniform<float> kUniformModelScale{"uModelScale"};
+static constexpr Uniform<glm::vec3> kUniformEyePosition{"uEyePosition"};
+static constexpr Uniform<float> kUniformProjectionScale{"uProjectionScale"};
+static constexpr Uniform<float> kUniformPixelError{"uPixelError"};
+static constexpr Uniform<GLint> kUniformUseOcclusion{"uUseOcclusion"};
+static constexpr Uniform<glm::mat4> kUniformOcclusionViewProjection{
+    "uOcclusionViewProjection"};
+static constexpr Uniform<GLint> kUniformOcclusionLevels{"uOcclusionLevels"};
+
+void RPCullShader::Dispatch(const PassView &view, GLuint num_meshes,
+                            GLuint num_buckets, const SSBO &meshes,
+                            const SSBO &nodes, const SSBO &buckets,
+                            const SSBO &commands) const {
+  Frustum frustum = ExtractFrustum(view.view_projection);
+  glm::vec4 planes[6];
+  for (GLuint i = 0; i < 6; i++) {
+    planes[i] = glm::vec4(frustum.normal_x[i], frustum.normal_y[i],
+                          frustum.normal_z[i], frustum.distance[i]);
+  }
+  m_shader.SetUniform(kUniformNumMeshes, num_meshes);
+  m_shader.SetUniform(kUniformNumBuckets, num_buckets);
+  m_shader.SetUniform(kUniformFrustumPlanes, planes, 6);
+  m_shader.SetUniform(kUniformModelMatrix, view.model_matrix);
+  m_shader.SetUniform(kUniformModelScale, MaxScale(view.model_matrix));
+  m_shader.SetUniform(kUniformEyePosition, view.eye_position);
+  m_shader.SetUniform(kUniformProjectionScale, view.projection_scale);
+  m_shader.SetUniform(kUniformPixelError, view.pixel_error);
+  // the GPU reads this frame's pyramid directly instead of the readback
+  m_shader.SetUniform(kUniformUseOcclusion, view.occlusion != nullptr);
+  if (view.occlusion != nullptr) {
+    m_shader.SetUniform(kUniformOcclusionViewProjection,
+                        view.occlusion->GetPyramidViewProjection());
+    m_shader.SetUniform(kUniformOcclusionLevels,
+                        view.occlusion->GetPyramidLevels());
+    GetGLState().ActiveTexture(GL_TEXTURE0 + m_hiz_texture);
+    view.occlusion->GetPyramidTexture().BindTexture(GL_TEXTURE_2D);
+  }
+
+  GLuint program = GetGLState().GetProgram();
+  m_shader.UseProgram();
+  meshes.BindBufferBase(m_mesh_block_binding);
+  nodes.BindBufferBase(m_node_block_binding);
+  commands.BindBufferBase(m_command_block_binding);
+  buckets.BindBufferBase(m_bucket_block_binding);
+  GLuint num_commands = num_buckets * num_meshes;
+  glDispatchCompute((num_commands + kCullGroupSize - 1) / kCullGroupSize, 1,
+                    1);
+  GetGLState().UseProgram(program);
+  if (view.occlusion != nullptr) {
+    GetGLState().BindTexture(GL_TEXTURE_2D, 0);
+  }
+};
@@ -0,0 +1,42 @@
+#include "RenderPass.hpp"
+#include <cstring>
+#include <iostream>
+
+static GLuint AlignUp(GLuint offset, GLuint alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+RPFrame::RPFrame() {
+  GLint alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  m_alignment = glm::max(alignment, 1);
+  m_draw_offset = AlignUp(sizeof(FrameBlock), m_alignment);
+  m_draw_stride = AlignUp(sizeof(DrawBlock), m_alignment);
+};
+
+void RPFrame::Update(RPStreamBuffer &stream, const FrameBlock &frame,
+                     const std::vector<DrawBlock> &draws) {
+  m_data.resize(m_draw_offset + draws.size() * m_draw_stride);
+  memcpy(&m_data[0], &frame, sizeof(frame));
+  for (GLuint i = 0; i < draws.size(); i++) {
+    memcpy(&m_data[m_draw_offset + i * m_draw_stride], &draws[i],
+           sizeof(draws[i]));
+  }
+  m_stream = &stream;
+  m_offset = stream.Write(m_data.data(), m_data.size(), m_alignment);
+  if (m_offset < 0) {
+    std::cerr << "Stream buffer full, frame uniforms dropped." << std::endl;
+    return;
+  }
+  stream.BindBufferRange(GL_UNIFORM_BUFFER, m_frame_block_binding, m_offset,
+                         sizeof(FrameBlock));
+};
+
+void RPFrame::BindDraw(GLuint draw) const {
+  if (m_offset < 0) {
+    return;
+  }
+  m_stream->BindBufferRange(GL_UNIFORM_BUFFER, m_draw_block_binding,
+                            m_offset + m_draw_offset + draw * m_draw_stride,
+                            sizeof(DrawBlock));
+};
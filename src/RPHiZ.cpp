@@ -0,0 +1,174 @@
+#include "RenderPass.hpp"
+#include <cstring>
+
+// power of two so every level halves exactly
+static const GLuint kHiZSize = 512;
+static const GLuint kHiZLevels = 10;
+// 64x64, small enough to read back and test on the CPU every frame
+static const GLuint kReadbackLevel = 3;
+static const GLuint kReadbackSize = kHiZSize >> kReadbackLevel;
+
+static constexpr Uniform<GLint> kUniformCopy{"uCopy"};
+
+RPHiZ::RPHiZ(ShaderLibrary &library)
+    : m_shader{library, "shaders/hiz_vertex.glsl",
+               "shaders/hiz_fragment.glsl"} {
+  m_pyramid_texture.BindTexture(GL_TEXTURE_2D);
+  glTexStorage2D(GL_TEXTURE_2D, kHiZLevels, GL_R32F, kHiZSize, kHiZSize);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  GetGLState().BindTexture(GL_TEXTURE_2D, 0);
+
+  m_readback_pbo.BufferData(kReadbackSize * kReadbackSize * sizeof(glm::vec4),
+                            NULL, GL_STREAM_READ);
+};
+
+RPHiZ::~RPHiZ() {
+  if (m_readback_fence != 0) {
+    glDeleteSync(m_readback_fence);
+  }
+};
+
+void RPHiZ::Update() {
+  if (m_readback_fence == 0) {
+    return;
+  }
+  GLenum result = glClientWaitSync(m_readback_fence, 0, 0);
+  if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+    return;
+  }
+  glDeleteSync(m_readback_fence);
+  m_readback_fence = 0;
+
+  // GL_RGBA/GL_FLOAT is the one float read format every driver supports
+  GLuint num_texels = kReadbackSize * kReadbackSize;
+  m_readback_pbo.BindBuffer();
+  const glm::vec4 *texels = (const glm::vec4 *)glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, num_texels * sizeof(glm::vec4),
+      GL_MAP_READ_BIT);
+  if (texels == nullptr) {
+    m_readback_pbo.Unbind();
+    return;
+  }
+  m_levels.assign(1, std::vector<float>(num_texels));
+  for (GLuint i = 0; i < num_texels; i++) {
+    m_levels[0][i] = texels[i].x;
+  }
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  m_readback_pbo.Unbind();
+  m_view_projection = m_readback_view_projection;
+
+  // continue the pyramid on the CPU so large boxes test a few texels only
+  for (GLuint size = kReadbackSize / 2; size > 0; size /= 2) {
+    const std::vector<float> &source = m_levels.back();
+    std::vector<float> level(size * size);
+    for (GLuint y = 0; y < size; y++) {
+      for (GLuint x = 0; x < size; x++) {
+        const float *row0 = &source[(y * 2) * size * 2 + x * 2];
+        const float *row1 = row0 + size * 2;
+        level[y * size + x] = glm::max(glm::max(row0[0], row0[1]),
+                                       glm::max(row1[0], row1[1]));
+      }
+    }
+    m_levels.push_back(std::move(level));
+  }
+};
+
+RGTextureDesc RPHiZ::GetDepthDesc() const {
+  return (RGTextureDesc){.width = kHiZSize,
+                         .height = kHiZSize,
+                         .internal_format = GL_DEPTH_COMPONENT32F,
+                         .sampler = RGS_NEAREST};
+};
+
+void RPHiZ::BuildPyramid(const glm::mat4 &view_projection,
+                         const RPTexture &depth) {
+  m_pyramid_view_projection = view_projection;
+  GLState &gl = GetGLState();
+  m_shader.UseProgram();
+  m_vao.BindVertexArray();
+  m_pyramid_fbo.BindFramebuffer(GL_FRAMEBUFFER);
+  gl.ActiveTexture(GL_TEXTURE0 + m_texture_binding);
+  for (GLuint level = 0; level < kHiZLevels; level++) {
+    GLuint size = kHiZSize >> level;
+    m_pyramid_texture.FramebufferTexture2D(
+        GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, level);
+    gl.Viewport(0, 0, size, size);
+    if (level == 0) {
+      depth.BindTexture(GL_TEXTURE_2D);
+      m_shader.SetUniform(kUniformCopy, GL_TRUE);
+    } else {
+      // only the source level may be visible to the sampler while the
+      // level below it is the render target
+      m_pyramid_texture.BindTexture(GL_TEXTURE_2D);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+      m_shader.SetUniform(kUniformCopy, GL_FALSE);
+    }
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // read back asynchronously unless the last readback is still in flight
+    if (level == kReadbackLevel && m_readback_fence == 0) {
+      m_readback_pbo.BindBuffer();
+      glReadBuffer(GL_COLOR_ATTACHMENT0);
+      glReadPixels(0, 0, kReadbackSize, kReadbackSize, GL_RGBA, GL_FLOAT, 0);
+      m_readback_pbo.Unbind();
+      m_readback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      m_readback_view_projection = view_projection;
+    }
+  }
+  m_pyramid_texture.BindTexture(GL_TEXTURE_2D);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, kHiZLevels - 1);
+  gl.BindTexture(GL_TEXTURE_2D, 0);
+};
+
+GLuint RPHiZ::GetPyramidLevels() const { return kHiZLevels; };
+
+bool RPHiZ::IsOccluded(const glm::vec3 &center,
+                       const glm::vec3 &extent) const {
+  if (m_levels.empty()) {
+    return false;
+  }
+  glm::vec2 ndc_min{1.0f};
+  glm::vec2 ndc_max{-1.0f};
+  float nearest_depth = 1.0f;
+  for (int i = 0; i < 8; i++) {
+    glm::vec3 corner{i & 1 ? extent.x : -extent.x, i & 2 ? extent.y : -extent.y,
+                     i & 4 ? extent.z : -extent.z};
+    glm::vec4 clip = m_view_projection * glm::vec4(center + corner, 1.0f);
+    // a box reaching behind the eye covers the whole view
+    if (clip.w <= 1e-5f) {
+      return false;
+    }
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    ndc_min = glm::min(ndc_min, glm::vec2(ndc.x, ndc.y));
+    ndc_max = glm::max(ndc_max, glm::vec2(ndc.x, ndc.y));
+    nearest_depth = glm::min(nearest_depth, ndc.z * 0.5f + 0.5f);
+  }
+  if (ndc_max.x < -1.0f || ndc_max.y < -1.0f || ndc_min.x > 1.0f ||
+      ndc_min.y > 1.0f) {
+    return false;
+  }
+  const float kSize = kReadbackSize;
+  glm::ivec2 texel_min{
+      glm::clamp((ndc_min * 0.5f + 0.5f) * kSize, 0.0f, kSize - 1.0f)};
+  glm::ivec2 texel_max{
+      glm::clamp((ndc_max * 0.5f + 0.5f) * kSize, 0.0f, kSize - 1.0f)};
+  // coarsest level where the box covers at most 2x2 texels
+  GLuint level = 0;
+  while (level + 1 < m_levels.size() &&
+         ((texel_max.x >> level) - (texel_min.x >> level) > 1 ||
+          (texel_max.y >> level) - (texel_min.y >> level) > 1)) {
+    level++;
+  }
+  const std::vector<float> &depths = m_levels[level];
+  GLuint size = kReadbackSize >> level;
+  float farthest_depth = 0.0f;
+  for (int y = texel_min.y >> level; y <= texel_max.y >> level; y++) {
+    for (int x = texel_min.x >> level; x <= texel_max.x >> level; x++) {
+      farthest_depth = glm::max(farthest_depth, depths[y * size + x]);
+    }
+  }
+  return nearest_depth > farthest_depth;
+};
@@ -1,46 +1,508 @@
 #include "RenderPass.hpp"
 #include "utils.hpp"
+#include <SDL.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
 
-RPMaterial::RPMaterial(const std::vector<Material> &materials,
-                       const std::vector<MeshVertexBuffer> &vertex_buffer_data,
-                       const std::vector<GLuint> &element_buffer_data) {
+// mat4 attributes take four consecutive vec4 locations
+static const GLuint kInstanceAttrib = 4;
+static const GLuint kNodeAttrib = 8;
+// Instances per InstanceBucket at most. Smaller buckets cull tighter but
+// cost a cull test and a set of draws each.
+static const GLuint kMaxBucketInstances = 64;
 
-  // Copy materials to GPU m_ubo
-  uint num_materials = materials.size();
-  BSDFMaterial material_data[num_materials];
-  for (uint i = 0; i < num_materials; i++) {
-    material_data[i] = materials[i].GetProperties();
-  }
-  m_ubo.BufferData(sizeof(material_data), material_data, GL_STATIC_DRAW);
+RPMaterial::RPMaterial(const MeshBuffers &buffers, MaterialTable &materials,
+                       bool is_streamed) {
+  AddMaterials(buffers, materials);
 
-  // copy vertex_buffer/element_buffer to GPU m_vbo/m_ebo
-  m_num_elements = element_buffer_data.size();
-  m_ebo.BufferData(element_buffer_data.size() * sizeof(element_buffer_data[0]),
-                   &element_buffer_data[0], GL_STATIC_DRAW);
-  m_vbo.BufferData(vertex_buffer_data.size() * sizeof(vertex_buffer_data[0]),
-                   &vertex_buffer_data[0], GL_STATIC_DRAW);
+  // allocate GPU m_vbo/m_ebo, filled by UploadBuffers
+  m_num_elements = buffers.num_elements;
+  m_num_vertices = buffers.num_vertices;
+  m_element_type = buffers.element_type;
+  m_vertex_decode = buffers.vertex_decode;
+  m_ebo.BufferData(buffers.num_elements * GetElementSize(m_element_type),
+                   nullptr, GL_STATIC_DRAW);
+  m_vbo.BufferData(buffers.num_vertices * sizeof(buffers.vertices[0]),
+                   nullptr, GL_STATIC_DRAW);
+  if (!is_streamed) {
+    UploadBuffers(buffers, std::numeric_limits<GLsizeiptr>::max());
+  }
 
   m_vao.BindVertexArray();
-  m_vao.VertexAttribPointer(m_vbo, 0, 3, GL_FLOAT, GL_FALSE,
+  m_vao.VertexAttribPointer(m_vbo, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE,
                             sizeof(MeshVertexBuffer), (GLvoid *)0);
-  m_vao.VertexAttribPointer(m_vbo, 1, 3, GL_FLOAT, GL_FALSE,
+  m_vao.VertexAttribPointer(m_vbo, 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
                             sizeof(MeshVertexBuffer),
                             (GLvoid *)(offsetof(MeshVertexBuffer, normal)));
   m_vao.VertexAttribIPointer(
-      m_vbo, 3, 1, GL_UNSIGNED_INT, sizeof(MeshVertexBuffer),
+      m_vbo, 3, 1, GL_UNSIGNED_SHORT, sizeof(MeshVertexBuffer),
       (GLvoid *)(offsetof(MeshVertexBuffer, material_idx)));
+  // per-instance transforms; the node matrix is a constant attribute set
+  // between draws
+  BindInstances(0);
+  for (GLuint i = 0; i < 4; i++) {
+    m_vao.VertexAttribDivisor(kInstanceAttrib + i, 1);
+  }
 
   m_ebo.BindBuffer();
 
   m_vao.Unbind();
   m_vbo.Unbind();
   m_ebo.Unbind();
+
+  glm::mat4 identity{1.0f};
+  SetInstances(&identity, 1);
+
+  SetMeshes(buffers);
+
+  const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+  if (extensions != nullptr &&
+      strstr(extensions, "GL_EXT_multi_draw_indirect")) {
+    m_multi_draw_indirect = (MultiDrawElementsIndirect)SDL_GL_GetProcAddress(
+        "glMultiDrawElementsIndirectEXT");
+  }
+};
+
+void RPMaterial::AddMaterials(const MeshBuffers &buffers,
+                              MaterialTable &materials) {
+  m_material_indices =
+      materials.AddGroup(buffers.materials, buffers.num_materials);
+  bool is_renumbered = false;
+  for (GLuint i = 0; i < m_material_indices.size(); i++) {
+    is_renumbered |= m_material_indices[i] != i;
+  }
+  if (!is_renumbered) {
+    m_material_indices.clear();
+  }
+};
+
+void RPMaterial::SetMeshes(const MeshBuffers &buffers) {
+  m_mesh_map.assign(buffers.mesh_map, buffers.mesh_map + buffers.num_meshes);
+
+  // inputs of the GPU culling pass, see RPCullShader
+  std::vector<CullMesh> cull_meshes(m_mesh_map.size());
+  m_node_runs.clear();
+  for (GLuint i = 0; i < m_mesh_map.size(); i++) {
+    const MeshMap &mesh_map = m_mesh_map[i];
+    CullMesh &cull_mesh = cull_meshes[i];
+    cull_mesh = (CullMesh){
+        .sphere = glm::vec4(mesh_map.center, mesh_map.radius),
+        .extent = glm::vec4(mesh_map.extent, 0.0f),
+        .node_idx = mesh_map.node_idx,
+        .num_lods = mesh_map.num_lods};
+    for (GLuint lod = 0; lod < mesh_map.num_lods; lod++) {
+      cull_mesh.lod_offsets[lod] = mesh_map.lods[lod].element_offset;
+      cull_mesh.lod_counts[lod] = mesh_map.lods[lod].element_count;
+      cull_mesh.lod_errors[lod] = mesh_map.lods[lod].error;
+    }
+    if (m_node_runs.empty() ||
+        m_node_runs.back().node_idx != mesh_map.node_idx) {
+      m_node_runs.push_back(
+          {.first_mesh = i, .num_meshes = 0, .node_idx = mesh_map.node_idx});
+    }
+    m_node_runs.back().num_meshes++;
+  }
+  m_cull_mesh_ssbo.BufferData(cull_meshes.size() * sizeof(cull_meshes[0]),
+                              cull_meshes.data(), GL_STATIC_DRAW);
+  AllocateCommands();
+};
+
+void RPMaterial::AllocateCommands() {
+  m_command_ssbo.BufferData(m_instance_buckets.size() * m_mesh_map.size() *
+                                sizeof(DrawElementsIndirectCommand),
+                            nullptr, GL_DYNAMIC_DRAW);
+};
+
+// Vertices as they are on the GPU, with material_idx in table numbering
+static const MeshVertexBuffer *
+RenumberVertices(const MeshVertexBuffer *vertices, GLuint num_vertices,
+                 const std::vector<GLuint> &material_indices,
+                 std::vector<MeshVertexBuffer> &renumbered) {
+  if (material_indices.empty()) {
+    return vertices;
+  }
+  renumbered.assign(vertices, vertices + num_vertices);
+  for (MeshVertexBuffer &vertex : renumbered) {
+    vertex.material_idx = material_indices[vertex.material_idx];
+  }
+  return renumbered.data();
+}
+
+// Compares old_data and data of size bytes in fixed blocks and uploads each
+// run of differing blocks with one BufferSubData. Returns the bytes uploaded.
+template <typename Buffer>
+static GLsizeiptr PatchBuffer(const Buffer &buffer, const char *old_data,
+                              const char *data, GLsizeiptr size) {
+  const GLsizeiptr kBlockSize = 4096;
+  GLsizeiptr num_bytes = 0;
+  GLsizeiptr run_begin = 0;
+  GLsizeiptr run_end = 0;
+  auto UploadRun = [&]() {
+    if (run_end > run_begin) {
+      buffer.BufferSubData(run_begin, run_end - run_begin, data + run_begin);
+      num_bytes += run_end - run_begin;
+    }
+  };
+  for (GLsizeiptr offset = 0; offset < size; offset += kBlockSize) {
+    GLsizeiptr block_size = std::min(kBlockSize, size - offset);
+    if (memcmp(old_data + offset, data + offset, block_size) == 0) {
+      continue;
+    }
+    if (offset != run_end) {
+      UploadRun();
+      run_begin = offset;
+    }
+    run_end = offset + block_size;
+  }
+  UploadRun();
+  return num_bytes;
+}
+
+GLsizeiptr RPMaterial::Reload(const MeshBuffers &old_buffers,
+                              const MeshBuffers &buffers,
+                              MaterialTable &materials) {
+  GLsizeiptr num_bytes = 0;
+  std::vector<GLuint> old_material_indices{std::move(m_material_indices)};
+  AddMaterials(buffers, materials);
+
+  std::vector<MeshVertexBuffer> old_renumbered{};
+  std::vector<MeshVertexBuffer> renumbered{};
+  const char *old_vertices = (const char *)RenumberVertices(
+      old_buffers.vertices, old_buffers.num_vertices, old_material_indices,
+      old_renumbered);
+  const char *vertices = (const char *)RenumberVertices(
+      buffers.vertices, buffers.num_vertices, m_material_indices, renumbered);
+  GLsizeiptr vertices_size = buffers.num_vertices * sizeof(buffers.vertices[0]);
+  if (buffers.num_vertices == old_buffers.num_vertices) {
+    num_bytes += PatchBuffer(m_vbo, old_vertices, vertices, vertices_size);
+  } else {
+    m_vbo.BufferData(vertices_size, vertices, GL_STATIC_DRAW);
+    num_bytes += vertices_size;
+  }
+
+  GLsizeiptr old_elements_size =
+      old_buffers.num_elements * GetElementSize(old_buffers.element_type);
+  GLsizeiptr elements_size =
+      buffers.num_elements * GetElementSize(buffers.element_type);
+  if (elements_size == old_elements_size) {
+    num_bytes += PatchBuffer(m_ebo, (const char *)old_buffers.elements,
+                             (const char *)buffers.elements, elements_size);
+  } else {
+    m_ebo.BufferData(elements_size, buffers.elements, GL_STATIC_DRAW);
+    num_bytes += elements_size;
+  }
+
+  m_num_elements = m_num_uploaded_elements = buffers.num_elements;
+  m_num_vertices = m_num_uploaded_vertices = buffers.num_vertices;
+  m_element_type = buffers.element_type;
+  m_vertex_decode = buffers.vertex_decode;
+  SetMeshes(buffers);
+  return num_bytes;
+};
+
+GLsizeiptr RPMaterial::UploadBuffers(const MeshBuffers &buffers,
+                                     GLsizeiptr max_bytes) {
+  GLsizeiptr num_bytes = 0;
+  const GLsizeiptr vertex_size = sizeof(buffers.vertices[0]);
+  GLuint num_vertices =
+      std::min<GLsizeiptr>(m_num_vertices - m_num_uploaded_vertices,
+                           max_bytes / vertex_size);
+  if (num_vertices > 0) {
+    std::vector<MeshVertexBuffer> renumbered{};
+    const MeshVertexBuffer *vertices =
+        RenumberVertices(buffers.vertices + m_num_uploaded_vertices,
+                         num_vertices, m_material_indices, renumbered);
+    m_vbo.BufferSubData(m_num_uploaded_vertices * vertex_size,
+                        num_vertices * vertex_size, vertices);
+    m_num_uploaded_vertices += num_vertices;
+    num_bytes += num_vertices * vertex_size;
+  }
+  if (m_num_uploaded_vertices < m_num_vertices) {
+    return num_bytes;
+  }
+  const GLsizeiptr element_size = GetElementSize(m_element_type);
+  GLuint num_elements =
+      std::min<GLsizeiptr>(m_num_elements - m_num_uploaded_elements,
+                           (max_bytes - num_bytes) / element_size);
+  if (num_elements > 0) {
+    const char *elements = (const char *)buffers.elements;
+    m_ebo.BufferSubData(m_num_uploaded_elements * element_size,
+                        num_elements * element_size,
+                        elements + m_num_uploaded_elements * element_size);
+    m_num_uploaded_elements += num_elements;
+    num_bytes += num_elements * element_size;
+  }
+  return num_bytes;
+};
+
+// Bounds of the instances order[first, first + count), pivoted on the one
+// nearest their centroid to keep the spread small
+static InstanceBucket MakeBucket(const glm::mat4 *transforms,
+                                 const std::vector<GLuint> &order,
+                                 GLuint first, GLuint count) {
+  glm::vec3 centroid{0.0f};
+  for (GLuint i = first; i < first + count; i++) {
+    centroid += glm::vec3(transforms[order[i]][3]) / (float)count;
+  }
+  GLuint pivot = order[first];
+  for (GLuint i = first; i < first + count; i++) {
+    if (glm::distance(glm::vec3(transforms[order[i]][3]), centroid) <
+        glm::distance(glm::vec3(transforms[pivot][3]), centroid)) {
+      pivot = order[i];
+    }
+  }
+  InstanceBucket bucket{.pivot = transforms[pivot],
+                        .spread = 0.0f,
+                        .scale = 0.0f,
+                        .first_instance = first,
+                        .num_instances = count};
+  for (GLuint i = first; i < first + count; i++) {
+    const glm::mat4 &transform = transforms[order[i]];
+    bucket.spread =
+        glm::max(bucket.spread, glm::distance(glm::vec3(transform[3]),
+                                              glm::vec3(bucket.pivot[3])));
+    bucket.scale = glm::max(bucket.scale, MaxScale(transform));
+  }
+  return bucket;
+}
+
+// Splits order[first, first + count) at the median of the widest axis of
+// its translations until every part fits a bucket
+static void SplitBuckets(const glm::mat4 *transforms,
+                         std::vector<GLuint> &order, GLuint first,
+                         GLuint count, std::vector<InstanceBucket> &buckets) {
+  if (count <= kMaxBucketInstances) {
+    buckets.push_back(MakeBucket(transforms, order, first, count));
+    return;
+  }
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+  for (GLuint i = first; i < first + count; i++) {
+    min = glm::min(min, glm::vec3(transforms[order[i]][3]));
+    max = glm::max(max, glm::vec3(transforms[order[i]][3]));
+  }
+  glm::vec3 size{max - min};
+  int axis = size.x >= size.y && size.x >= size.z ? 0
+             : size.y >= size.z                   ? 1
+                                                  : 2;
+  GLuint half = count / 2;
+  std::nth_element(order.begin() + first, order.begin() + first + half,
+                   order.begin() + first + count, [&](GLuint a, GLuint b) {
+                     return transforms[a][3][axis] < transforms[b][3][axis];
+                   });
+  SplitBuckets(transforms, order, first, half, buckets);
+  SplitBuckets(transforms, order, first + half, count - half, buckets);
+}
+
+void RPMaterial::SetInstances(const glm::mat4 *transforms,
+                              GLuint num_instances) {
+  m_num_instances = num_instances;
+  std::vector<GLuint> order(num_instances);
+  std::iota(order.begin(), order.end(), 0);
+  m_instance_buckets.clear();
+  if (num_instances > 0) {
+    SplitBuckets(transforms, order, 0, num_instances, m_instance_buckets);
+  }
+  // every bucket's instances are contiguous
+  std::vector<glm::mat4> sorted(num_instances);
+  for (GLuint i = 0; i < num_instances; i++) {
+    sorted[i] = transforms[order[i]];
+  }
+  m_instance_vbo.BufferData(num_instances * sizeof(sorted[0]), sorted.data(),
+                            GL_DYNAMIC_DRAW);
+  m_bucket_ssbo.BufferData(m_instance_buckets.size() *
+                               sizeof(m_instance_buckets[0]),
+                           m_instance_buckets.data(), GL_DYNAMIC_DRAW);
+  AllocateCommands();
+};
+
+void RPMaterial::BindInstances(GLuint first_instance) const {
+  for (GLuint i = 0; i < 4; i++) {
+    m_vao.VertexAttribPointer(
+        m_instance_vbo, kInstanceAttrib + i, 4, GL_FLOAT, GL_FALSE,
+        sizeof(glm::mat4),
+        (GLvoid *)(first_instance * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+  }
+};
+
+void RPMaterial::SetNodeMatrices(
+    const std::vector<glm::mat4> &node_matrices) const {
+  m_node_ssbo.BufferData(node_matrices.size() * sizeof(node_matrices[0]),
+                         node_matrices.data(), GL_DYNAMIC_DRAW);
+};
+
+DrawStats RPMaterial::DrawVertices(
+    const std::vector<glm::mat4> &node_matrices) const {
+  // nothing is culled, so all buckets are drawn together
+  InstanceBucket all{.pivot = glm::mat4{1.0f},
+                     .spread = 0.0f,
+                     .scale = 1.0f,
+                     .first_instance = 0,
+                     .num_instances = m_num_instances};
+  return DrawMeshes(node_matrices, all, [](GLuint) { return 0; });
+};
+
+// LOD to draw the bucket's copies of a mesh at, or -1 if they are culled
+static GLint SelectLod(const PassView &view, const Frustum &frustum,
+                       float model_scale, const InstanceBucket &bucket,
+                       const MeshMap &mesh_map,
+                       const std::vector<glm::mat4> &node_matrices) {
+  const glm::mat4 &model = view.model_matrix;
+  const glm::mat4 &node_matrix = node_matrices[mesh_map.node_idx];
+  float node_scale = MaxScale(node_matrix);
+  glm::vec3 node_center{node_matrix * glm::vec4(mesh_map.center, 1.0f)};
+  // any other instance's copy is at most its translation away from the
+  // pivot, plus both rotating/scaling the centre
+  float spread = 0.0f;
+  if (bucket.num_instances > 1) {
+    spread = bucket.spread + 2.0f * bucket.scale * glm::length(node_center);
+  }
+  glm::vec3 center{model * bucket.pivot * glm::vec4(node_center, 1.0f)};
+  float mesh_radius = bucket.scale * node_scale * mesh_map.radius;
+  float radius = model_scale * (mesh_radius + spread);
+  if (!IsSphereVisible(frustum, center, radius)) {
+    return -1;
+  }
+  // a single copy can be tested exactly with its box
+  glm::vec3 box_center{center};
+  glm::vec3 box_extent{radius};
+  if (bucket.num_instances == 1) {
+    TransformBox(model * bucket.pivot * node_matrix, mesh_map.center,
+                 mesh_map.extent, box_center, box_extent);
+    if (!IsBoxVisible(frustum, box_center, box_extent)) {
+      return -1;
+    }
+  }
+  if (view.occlusion != nullptr &&
+      view.occlusion->IsOccluded(box_center, box_extent)) {
+    return -1;
+  }
+
+  float distance =
+      glm::max(glm::distance(center, view.eye_position) - radius, 1e-3f);
+  float pixels_per_unit = model_scale * bucket.scale * node_scale *
+                          view.projection_scale / distance;
+  GLint lod = 0;
+  while (lod + 1 < (GLint)mesh_map.num_lods &&
+         mesh_map.lods[lod + 1].error * pixels_per_unit <= view.pixel_error) {
+    lod++;
+  }
+  return lod;
+}
+
+DrawStats
+RPMaterial::DrawVisible(const PassView &view,
+                        const std::vector<glm::mat4> &node_matrices) const {
+  float model_scale = MaxScale(view.model_matrix);
+  Frustum frustum = ExtractFrustum(view.view_projection);
+  DrawStats stats{};
+  for (const InstanceBucket &bucket : m_instance_buckets) {
+    stats += DrawMeshes(node_matrices, bucket, [&](GLuint mesh_idx) {
+      return SelectLod(view, frustum, model_scale, bucket,
+                       m_mesh_map[mesh_idx], node_matrices);
+    });
+  }
+  return stats;
+};
+
+DrawStats
+RPMaterial::DrawMeshes(const std::vector<glm::mat4> &node_matrices,
+                       const InstanceBucket &bucket,
+                       const std::function<GLint(GLuint)> &select_lod) const {
+  DrawStats stats{};
+  if (bucket.num_instances == 0) {
+    return stats;
+  }
+  GLuint element_size = GetElementSize(m_element_type);
+  GLuint num_elements = 0;
+  GLuint range_offset = 0;
+  GLuint range_count = 0;
+  GLint range_node = -1;
+  GLint attrib_node = -1;
+  auto DrawRange = [&]() {
+    if (range_count == 0) {
+      return;
+    }
+    if (range_node != attrib_node) {
+      const glm::mat4 &node_matrix = node_matrices[range_node];
+      for (GLuint i = 0; i < 4; i++) {
+        glVertexAttrib4fv(kNodeAttrib + i, &node_matrix[i][0]);
+      }
+      attrib_node = range_node;
+    }
+    glDrawElementsInstanced(
+        GL_TRIANGLES, range_count, m_element_type,
+        (GLvoid *)(uintptr_t)(range_offset * element_size),
+        bucket.num_instances);
+    stats.draw_calls++;
+  };
+  m_vao.BindVertexArray();
+  BindInstances(bucket.first_instance);
+  for (uint mesh_idx = 0; mesh_idx < m_mesh_map.size(); mesh_idx++) {
+    const MeshMap &mesh_map = m_mesh_map[mesh_idx];
+    GLint lod = select_lod(mesh_idx);
+    if (lod < 0) {
+      continue;
+    }
+    const MeshLod &mesh_lod = mesh_map.lods[lod];
+    stats.meshes++;
+    num_elements += mesh_lod.element_count;
+    // meshes of one node drawn at the same LOD are contiguous, merge them
+    if ((GLint)mesh_map.node_idx == range_node &&
+        range_offset + range_count == mesh_lod.element_offset) {
+      range_count += mesh_lod.element_count;
+      continue;
+    }
+    DrawRange();
+    range_node = mesh_map.node_idx;
+    range_offset = mesh_lod.element_offset;
+    range_count = mesh_lod.element_count;
+  }
+  DrawRange();
+  stats.triangles = num_elements / 3 * bucket.num_instances;
+  return stats;
 };
 
-void RPMaterial::DrawVertices() const {
+DrawStats
+RPMaterial::DrawIndirect(const RPCullShader &cull_shader, const PassView &view,
+                         const std::vector<glm::mat4> &node_matrices) const {
+  // One indirect draw per mesh would cost more to submit than the merged
+  // ranges of the CPU path
+  if (m_multi_draw_indirect == nullptr) {
+    return DrawVisible(view, node_matrices);
+  }
+  DrawStats stats{};
+  if (m_mesh_map.empty()) {
+    return stats;
+  }
+  cull_shader.Dispatch(view, m_mesh_map.size(), m_instance_buckets.size(),
+                       m_cull_mesh_ssbo, m_node_ssbo, m_bucket_ssbo,
+                       m_command_ssbo);
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+  const GLsizei stride = sizeof(DrawElementsIndirectCommand);
   m_vao.BindVertexArray();
-  glDrawElements(GL_TRIANGLES, m_num_elements, GL_UNSIGNED_INT, 0);
-  m_vao.Unbind();
+  m_command_ssbo.BindBuffer(GL_DRAW_INDIRECT_BUFFER);
+  for (GLuint b = 0; b < m_instance_buckets.size(); b++) {
+    BindInstances(m_instance_buckets[b].first_instance);
+    GLuint first_command = b * m_mesh_map.size();
+    // GLES has no gl_DrawID, so the node matrix stays a constant attribute
+    // and every node gets its own draws
+    for (const NodeRun &run : m_node_runs) {
+      const glm::mat4 &node_matrix = node_matrices[run.node_idx];
+      for (GLuint i = 0; i < 4; i++) {
+        glVertexAttrib4fv(kNodeAttrib + i, &node_matrix[i][0]);
+      }
+      GLuint first = first_command + run.first_mesh;
+      m_multi_draw_indirect(GL_TRIANGLES, m_element_type,
+                            (GLvoid *)(uintptr_t)(first * stride),
+                            run.num_meshes, stride);
+      stats.draw_calls++;
+    }
+  }
+  return stats;
 };
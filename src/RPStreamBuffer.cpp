@@ -0,0 +1,104 @@
+#include "RenderPass.hpp"
+#include <SDL.h>
+#include <cstring>
+
+// from GL_EXT_buffer_storage
+static const GLbitfield kMapPersistentBit = 0x0040;
+static const GLbitfield kMapCoherentBit = 0x0080;
+// how long a stalled BeginFrame waits before giving up on the fence
+static const GLuint64 kFenceTimeoutNs = 1000000000;
+
+static GLintptr AlignUp(GLintptr offset, GLuint alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+RPStreamBuffer::RPStreamBuffer(GLsizeiptr frame_size)
+    : m_frame_size{frame_size} {
+  GLsizeiptr size = m_frame_size * kFramesInFlight;
+  BufferStorage buffer_storage = nullptr;
+  const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+  if (extensions != nullptr && strstr(extensions, "GL_EXT_buffer_storage")) {
+    buffer_storage =
+        (BufferStorage)SDL_GL_GetProcAddress("glBufferStorageEXT");
+  }
+  glGenBuffers(1, &m_buffer);
+  // the copy target leaves the bindings draws rely on alone
+  GetGLState().BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+  if (buffer_storage != nullptr) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | kMapPersistentBit | kMapCoherentBit;
+    buffer_storage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+    m_mapping =
+        (char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+  } else {
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+  }
+};
+
+RPStreamBuffer::~RPStreamBuffer() {
+  for (GLsync fence : m_fences) {
+    if (fence != 0) {
+      glDeleteSync(fence);
+    }
+  }
+  if (m_buffer != 0) {
+    // deleting the buffer also unmaps it
+    GetGLState().DeleteBuffer(m_buffer);
+  }
+};
+
+RPStreamBuffer::RPStreamBuffer(RPStreamBuffer &&other)
+    : m_buffer{other.m_buffer}, m_frame_size{other.m_frame_size},
+      m_mapping{other.m_mapping}, m_frame{other.m_frame},
+      m_frame_used{other.m_frame_used}, m_num_stalls{other.m_num_stalls} {
+  for (GLuint i = 0; i < kFramesInFlight; i++) {
+    m_fences[i] = other.m_fences[i];
+    other.m_fences[i] = 0;
+  }
+  other.m_buffer = 0;
+  other.m_mapping = nullptr;
+};
+
+void RPStreamBuffer::BeginFrame() {
+  m_frame = (m_frame + 1) % kFramesInFlight;
+  m_frame_used = 0;
+  GLsync fence = m_fences[m_frame];
+  if (fence == 0) {
+    return;
+  }
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    m_num_stalls++;
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeoutNs);
+  }
+  glDeleteSync(fence);
+  m_fences[m_frame] = 0;
+};
+
+void RPStreamBuffer::EndFrame() {
+  m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+};
+
+GLintptr RPStreamBuffer::Write(const void *data, GLsizeiptr size,
+                               GLuint alignment) {
+  GLintptr frame_offset = AlignUp(m_frame_used, alignment);
+  if (frame_offset + size > m_frame_size) {
+    return -1;
+  }
+  m_frame_used = frame_offset + size;
+  GLintptr offset = m_frame * m_frame_size + frame_offset;
+  if (m_mapping != nullptr) {
+    memcpy(m_mapping + offset, data, size);
+    return offset;
+  }
+  // the fence already guarantees the GPU is done with this range
+  GetGLState().BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+  void *mapping = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                   GL_MAP_WRITE_BIT |
+                                       GL_MAP_INVALIDATE_RANGE_BIT |
+                                       GL_MAP_UNSYNCHRONIZED_BIT);
+  if (mapping != nullptr) {
+    memcpy(mapping, data, size);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+  }
+  return offset;
+};
@@ -1,11 +1,8 @@
 #include "RenderPass.hpp"
 
-RPTex::RPTex()
-    : m_shader{"shaders/texture_vertex.glsl", "shaders/texture_fragment.glsl"} {
-  m_shader.UseProgram();
-  m_shader.Uniform1i("uTexture", m_texture_binding);
-  glUseProgram(0);
-
+RPTex::RPTex(ShaderLibrary &library)
+    : m_shader{library, "shaders/texture_vertex.glsl",
+               "shaders/texture_fragment.glsl"} {
   struct TexVert {
     glm::vec3 position;  // -1 to 1
     glm::vec2 tex_coord; // 0 to 1
@@ -25,10 +22,8 @@ RPTex::RPTex()
 };
 void RPTex::Draw(const RPTexture &texture) const {
   m_shader.UseProgram();
-  glActiveTexture(GL_TEXTURE0 + m_texture_binding);
+  GetGLState().ActiveTexture(GL_TEXTURE0 + m_texture_binding);
   texture.BindTexture(GL_TEXTURE_2D);
   m_vao.BindVertexArray();
   glDrawArrays(GL_TRIANGLES, 0, 3);
-  m_vao.Unbind();
-  glUseProgram(0);
 };
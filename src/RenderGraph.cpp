@@ -0,0 +1,337 @@
+#include "RenderPass.hpp"
+#include <algorithm>
+#include <iostream>
+#include <stdio.h>
+
+static bool IsSameDesc(const RGTextureDesc &a, const RGTextureDesc &b) {
+  return a.width == b.width && a.height == b.height &&
+         a.internal_format == b.internal_format && a.sampler == b.sampler;
+}
+
+static GLenum GetAttachment(GLenum internal_format) {
+  switch (internal_format) {
+  case GL_DEPTH_COMPONENT16:
+  case GL_DEPTH_COMPONENT24:
+  case GL_DEPTH_COMPONENT32F:
+    return GL_DEPTH_ATTACHMENT;
+  case GL_DEPTH24_STENCIL8:
+  case GL_DEPTH32F_STENCIL8:
+    return GL_DEPTH_STENCIL_ATTACHMENT;
+  default:
+    return GL_COLOR_ATTACHMENT0;
+  }
+}
+
+void RenderGraph::Begin(const glm::ivec2 &size, const glm::vec4 &clear_color) {
+  m_size = size;
+  m_clear_color = clear_color;
+  m_passes.clear();
+  m_resources.clear();
+  m_resources.push_back((Resource){.name = "backbuffer",
+                                   .imported = nullptr,
+                                   .target = GL_TEXTURE_2D,
+                                   .desc = {},
+                                   .physical = -1});
+};
+
+RGResource RenderGraph::ImportTexture(const std::string &name,
+                                      const RPTexture &texture,
+                                      GLenum target) {
+  m_resources.push_back((Resource){.name = name,
+                                   .imported = &texture,
+                                   .target = target,
+                                   .desc = {},
+                                   .physical = -1});
+  return m_resources.size() - 1;
+};
+
+RGResource RenderGraph::CreateTexture(const std::string &name,
+                                      const RGTextureDesc &desc) {
+  m_resources.push_back((Resource){.name = name,
+                                   .imported = nullptr,
+                                   .target = GL_TEXTURE_2D,
+                                   .desc = desc,
+                                   .physical = -1});
+  return m_resources.size() - 1;
+};
+
+void RenderGraph::AddPass(RGPass pass) {
+  if (pass.target != kNoTarget && pass.target != kBackbuffer &&
+      m_resources[pass.target].imported != nullptr) {
+    std::cerr << "RenderGraph: " << pass.name << " draws into imported "
+              << m_resources[pass.target].name << ", which has no framebuffer"
+              << std::endl;
+    pass.writes.push_back(pass.target);
+    pass.target = kNoTarget;
+  }
+  m_passes.push_back(std::move(pass));
+};
+
+const RPTexture &RenderGraph::GetTexture(RGResource resource) const {
+  const Resource &r = m_resources[resource];
+  if (r.imported != nullptr) {
+    return *r.imported;
+  }
+  return m_targets[r.physical].texture;
+};
+
+std::vector<GLuint> RenderGraph::Schedule() {
+  GLuint num_passes = m_passes.size();
+  // enabled writers of every resource, in declaration order
+  std::vector<std::vector<GLuint>> writers(m_resources.size());
+  for (GLuint p = 0; p < num_passes; p++) {
+    const RGPass &pass = m_passes[p];
+    if (!pass.enabled) {
+      continue;
+    }
+    if (pass.target != kNoTarget) {
+      writers[pass.target].push_back(p);
+    }
+    for (RGResource resource : pass.writes) {
+      writers[resource].push_back(p);
+    }
+  }
+  // A pass depends on every writer of what it reads, and on the writer of
+  // its outputs declared right before it so draws into one target keep
+  // their order
+  std::vector<std::vector<GLuint>> dependencies(num_passes);
+  auto AddOutput = [&](GLuint p, RGResource resource) {
+    const std::vector<GLuint> &w = writers[resource];
+    auto it = std::find(w.begin(), w.end(), p);
+    if (it != w.begin()) {
+      dependencies[p].push_back(*(it - 1));
+    }
+  };
+  for (GLuint p = 0; p < num_passes; p++) {
+    const RGPass &pass = m_passes[p];
+    if (!pass.enabled) {
+      continue;
+    }
+    for (const RGRead &read : pass.reads) {
+      for (GLuint writer : writers[read.resource]) {
+        if (writer != p) {
+          dependencies[p].push_back(writer);
+        }
+      }
+    }
+    if (pass.target != kNoTarget) {
+      AddOutput(p, pass.target);
+    }
+    for (RGResource resource : pass.writes) {
+      AddOutput(p, resource);
+    }
+  }
+
+  // topological order, declaration order among passes that are ready
+  std::vector<GLuint> order{};
+  std::vector<bool> is_scheduled(num_passes, false);
+  GLuint num_enabled = 0;
+  for (const RGPass &pass : m_passes) {
+    num_enabled += pass.enabled;
+  }
+  while (order.size() < num_enabled) {
+    GLint next = -1;
+    for (GLuint p = 0; p < num_passes && next < 0; p++) {
+      if (!m_passes[p].enabled || is_scheduled[p]) {
+        continue;
+      }
+      bool is_ready = true;
+      for (GLuint dependency : dependencies[p]) {
+        is_ready = is_ready && is_scheduled[dependency];
+      }
+      if (is_ready) {
+        next = p;
+      }
+    }
+    if (next < 0) {
+      std::cerr << "RenderGraph: dependency cycle, running the remaining "
+                   "passes in declaration order"
+                << std::endl;
+      for (GLuint p = 0; p < num_passes; p++) {
+        if (m_passes[p].enabled && !is_scheduled[p]) {
+          is_scheduled[p] = true;
+          order.push_back(p);
+        }
+      }
+      break;
+    }
+    is_scheduled[next] = true;
+    order.push_back(next);
+  }
+
+  // only passes drawing to the screen or with side effects are needed,
+  // and everything they depend on
+  std::vector<bool> is_needed(num_passes, false);
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    const RGPass &pass = m_passes[*it];
+    if (pass.side_effects || pass.target == kBackbuffer) {
+      is_needed[*it] = true;
+    }
+    if (is_needed[*it]) {
+      for (GLuint dependency : dependencies[*it]) {
+        is_needed[dependency] = true;
+      }
+    }
+  }
+  std::vector<GLuint> needed{};
+  for (GLuint p : order) {
+    if (is_needed[p]) {
+      needed.push_back(p);
+    }
+  }
+  m_num_culled = order.size() - needed.size();
+  return needed;
+};
+
+GLuint RenderGraph::CreateTarget(const RGTextureDesc &desc) {
+  Target target{.desc = desc, .texture = {}, .fbo = {}, .last_use = -1};
+  target.texture.BindTexture(GL_TEXTURE_2D);
+  glTexStorage2D(GL_TEXTURE_2D, 1, desc.internal_format, desc.width,
+                 desc.height);
+  GLint filter = desc.sampler == RGS_NEAREST ? GL_NEAREST : GL_LINEAR;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  if (desc.sampler == RGS_SHADOW) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE,
+                    GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glm::vec4 border_color{0.0};
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
+  } else {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+
+  target.fbo.BindFramebuffer(GL_DRAW_FRAMEBUFFER);
+  target.texture.FramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
+                                      GetAttachment(desc.internal_format),
+                                      GL_TEXTURE_2D, 0);
+  GLenum status = target.fbo.CheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    printf("FB error, status: 0x%x\n", status);
+  }
+  m_targets.push_back(std::move(target));
+  return m_targets.size() - 1;
+};
+
+void RenderGraph::Allocate(const std::vector<GLuint> &order) {
+  for (Target &target : m_targets) {
+    target.last_use = -1;
+  }
+  // first and last position of every resource in order
+  std::vector<GLint> first(m_resources.size(), -1);
+  std::vector<GLint> last(m_resources.size(), -1);
+  for (GLuint i = 0; i < order.size(); i++) {
+    const RGPass &pass = m_passes[order[i]];
+    auto Use = [&](RGResource resource) {
+      if (first[resource] < 0) {
+        first[resource] = i;
+      }
+      last[resource] = i;
+    };
+    for (const RGRead &read : pass.reads) {
+      Use(read.resource);
+    }
+    if (pass.target != kNoTarget) {
+      Use(pass.target);
+    }
+    for (RGResource resource : pass.writes) {
+      Use(resource);
+    }
+  }
+  // by first use, so storage is handed on once its last user has run
+  std::vector<RGResource> transients{};
+  for (RGResource r = 0; r < m_resources.size(); r++) {
+    if (r != kBackbuffer && m_resources[r].imported == nullptr &&
+        first[r] >= 0) {
+      transients.push_back(r);
+    }
+  }
+  std::stable_sort(
+      transients.begin(), transients.end(),
+      [&](RGResource a, RGResource b) { return first[a] < first[b]; });
+  for (RGResource r : transients) {
+    Resource &resource = m_resources[r];
+    resource.physical = -1;
+    for (GLuint t = 0; t < m_targets.size() && resource.physical < 0; t++) {
+      if (IsSameDesc(m_targets[t].desc, resource.desc) &&
+          m_targets[t].last_use < first[r]) {
+        resource.physical = t;
+      }
+    }
+    if (resource.physical < 0) {
+      resource.physical = CreateTarget(resource.desc);
+    }
+    m_targets[resource.physical].last_use = last[r];
+  }
+};
+
+void RenderGraph::BindTarget(RGResource target, bool clear) const {
+  GLState &gl = GetGLState();
+  // the backbuffer has colour and depth, transient targets one of them
+  bool has_color = true;
+  bool has_depth = true;
+  if (target == kBackbuffer) {
+    gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    gl.Viewport(0, 0, m_size.x, m_size.y);
+  } else {
+    const Target &physical = m_targets[m_resources[target].physical];
+    physical.fbo.BindFramebuffer(GL_DRAW_FRAMEBUFFER);
+    gl.Viewport(0, 0, physical.desc.width, physical.desc.height);
+    has_color =
+        GetAttachment(physical.desc.internal_format) == GL_COLOR_ATTACHMENT0;
+    has_depth = !has_color;
+  }
+  if (clear && has_depth) {
+    glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  }
+  if (clear && has_color) {
+    glClearBufferfv(GL_COLOR, 0, &m_clear_color[0]);
+  }
+};
+
+void RenderGraph::Execute() {
+  std::vector<GLuint> order = Schedule();
+  Allocate(order);
+  GLState &gl = GetGLState();
+  std::vector<bool> is_cleared(m_resources.size(), false);
+  for (GLuint p : order) {
+    const RGPass &pass = m_passes[p];
+    if (pass.target != kNoTarget) {
+      // the contents of a target are undefined until its first pass
+      BindTarget(pass.target, !is_cleared[pass.target]);
+      is_cleared[pass.target] = true;
+    }
+    gl.SetEnabled(GL_DEPTH_TEST, pass.state.depth_test);
+    gl.SetEnabled(GL_CULL_FACE, pass.state.cull_face);
+    if (pass.state.cull_face) {
+      gl.CullFace(pass.state.cull_mode);
+      gl.FrontFace(pass.state.front_face);
+    }
+    for (const RGRead &read : pass.reads) {
+      if (read.unit != kNoUnit) {
+        gl.ActiveTexture(GL_TEXTURE0 + read.unit);
+        const Resource &resource = m_resources[read.resource];
+        GetTexture(read.resource).BindTexture(resource.target);
+      }
+    }
+    pass.execute();
+  }
+  gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+  gl.Viewport(0, 0, m_size.x, m_size.y);
+  m_num_executed = order.size();
+
+  // storage this frame did not need is freed rather than kept around
+  std::vector<Target> used{};
+  for (Target &target : m_targets) {
+    if (target.last_use >= 0) {
+      used.push_back(std::move(target));
+    }
+  }
+  m_targets = std::move(used);
+  for (Resource &resource : m_resources) {
+    resource.physical = -1;
+  }
+};
@@ -1,9 +1,14 @@
 #pragma once
+#include "Frustum.hpp"
+#include "GLState.hpp"
 #include "Material.hpp"
 #include "Mesh.hpp"
+#include "MeshGroup.hpp"
 #include "Shader.hpp"
 #include "gl.hpp"
 #include "utils.hpp"
+#include <functional>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -41,12 +46,14 @@ struct TextureTileConfig {
   float parallel_bias;
 };
 
+// The buffer helpers leave their buffer bound after an upload, GLState
+// skips binding it again for the next one
 class VBO {
 public:
   VBO() { glGenBuffers(1, &m_vbo); }
   ~VBO() {
     if (m_vbo != 0) {
-      glDeleteBuffers(1, &m_vbo);
+      GetGLState().DeleteBuffer(m_vbo);
     };
   }
   NEVER_COPY(VBO);
@@ -54,10 +61,13 @@ public:
   void BufferData(GLsizeiptr size, const void *data, GLenum usage) const {
     BindBuffer();
     glBufferData(GL_ARRAY_BUFFER, size, data, usage);
-    Unbind();
   };
-  void BindBuffer() const { glBindBuffer(GL_ARRAY_BUFFER, m_vbo); }
-  void Unbind() const { glBindBuffer(GL_ARRAY_BUFFER, 0); }
+  void BufferSubData(GLintptr offset, GLsizeiptr size, const void *data) const {
+    BindBuffer();
+    glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+  };
+  void BindBuffer() const { GetGLState().BindBuffer(GL_ARRAY_BUFFER, m_vbo); }
+  void Unbind() const { GetGLState().BindBuffer(GL_ARRAY_BUFFER, 0); }
 
 private:
   GLuint m_vbo;
@@ -68,20 +78,19 @@ public:
   VAO() { glGenVertexArrays(1, &m_vao); };
   ~VAO() {
     if (m_vao != 0) {
-      glDeleteVertexArrays(1, &m_vao);
+      GetGLState().DeleteVertexArray(m_vao);
     };
   }
   NEVER_COPY(VAO);
   VAO(VAO &&other) : m_vao{other.m_vao} { other.m_vao = 0; };
 
-  void BindVertexArray() const { glBindVertexArray(m_vao); };
+  void BindVertexArray() const { GetGLState().BindVertexArray(m_vao); };
   void VertexAttribPointer(const VBO &vbo, GLuint index, GLint size,
                            GLenum type, GLboolean normalized, GLsizei stride,
                            const void *offset) const {
     glEnableVertexAttribArray(index);
     vbo.BindBuffer();
     glVertexAttribPointer(index, size, type, normalized, stride, offset);
-    vbo.Unbind();
   };
   void VertexAttribIPointer(const VBO &vbo, GLuint index, GLint size,
                             GLenum type, GLsizei stride,
@@ -89,9 +98,11 @@ public:
     glEnableVertexAttribArray(index);
     vbo.BindBuffer();
     glVertexAttribIPointer(index, size, type, stride, offset);
-    vbo.Unbind();
   };
-  void Unbind() const { glBindVertexArray(0); };
+  void VertexAttribDivisor(GLuint index, GLuint divisor) const {
+    glVertexAttribDivisor(index, divisor);
+  };
+  void Unbind() const { GetGLState().BindVertexArray(0); };
 
 private:
   GLuint m_vao;
@@ -102,19 +113,26 @@ public:
   EBO() { glGenBuffers(1, &m_ebo); }
   ~EBO() {
     if (m_ebo != 0) {
-      glDeleteBuffers(1, &m_ebo);
+      GetGLState().DeleteBuffer(m_ebo);
     }
   }
   NEVER_COPY(EBO);
   EBO(EBO &&other) : m_ebo{other.m_ebo} { other.m_ebo = 0; };
 
+  // Uploads go through GL_COPY_WRITE_BUFFER, the element array binding
+  // would change whichever VAO is bound
   void BufferData(GLsizeiptr size, const void *data, GLenum usage) const {
-    BindBuffer();
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, usage);
-    Unbind();
+    GetGLState().BindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+  };
+  void BufferSubData(GLintptr offset, GLsizeiptr size, const void *data) const {
+    GetGLState().BindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
   };
-  void BindBuffer() const { glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo); }
-  void Unbind() const { glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); }
+  void BindBuffer() const {
+    GetGLState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+  }
+  void Unbind() const { GetGLState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); }
 
 private:
   GLuint m_ebo;
@@ -125,47 +143,100 @@ public:
   UBO() { glGenBuffers(1, &m_ubo); };
   ~UBO() {
     if (m_ubo != 0) {
-      glDeleteBuffers(1, &m_ubo);
+      GetGLState().DeleteBuffer(m_ubo);
     };
   }
   NEVER_COPY(UBO);
   UBO(UBO &&other) : m_ubo{other.m_ubo} { other.m_ubo = 0; };
 
   void BindBufferBase(GLuint block_binding_index) const {
-    glBindBufferBase(GL_UNIFORM_BUFFER, block_binding_index, m_ubo);
+    GetGLState().BindBufferBase(GL_UNIFORM_BUFFER, block_binding_index, m_ubo);
   };
-  void BindBuffer() const { glBindBuffer(GL_UNIFORM_BUFFER, m_ubo); }
-  void Unbind() const { glBindBuffer(GL_UNIFORM_BUFFER, 0); }
+  void BindBuffer() const { GetGLState().BindBuffer(GL_UNIFORM_BUFFER, m_ubo); }
+  void Unbind() const { GetGLState().BindBuffer(GL_UNIFORM_BUFFER, 0); }
   void BufferData(GLsizeiptr size, const void *data, GLenum usage) const {
     BindBuffer();
     glBufferData(GL_UNIFORM_BUFFER, size, data, usage);
-    Unbind();
   };
   void BufferSubData(GLintptr offset, GLsizeiptr size, const void *data) const {
     BindBuffer();
     glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
-    Unbind();
   };
 
 private:
   GLuint m_ubo;
 };
 
+class SSBO {
+public:
+  SSBO() { glGenBuffers(1, &m_ssbo); };
+  ~SSBO() {
+    if (m_ssbo != 0) {
+      GetGLState().DeleteBuffer(m_ssbo);
+    };
+  }
+  NEVER_COPY(SSBO);
+  SSBO(SSBO &&other) : m_ssbo{other.m_ssbo} { other.m_ssbo = 0; };
+
+  void BindBufferBase(GLuint block_binding_index) const {
+    GetGLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, block_binding_index,
+                                m_ssbo);
+  };
+  // also bound as GL_DRAW_INDIRECT_BUFFER to draw commands written on the GPU
+  void BindBuffer(GLenum target) const {
+    GetGLState().BindBuffer(target, m_ssbo);
+  }
+  void Unbind(GLenum target) const { GetGLState().BindBuffer(target, 0); }
+  void BufferData(GLsizeiptr size, const void *data, GLenum usage) const {
+    BindBuffer(GL_SHADER_STORAGE_BUFFER);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, usage);
+  };
+
+private:
+  GLuint m_ssbo;
+};
+
+class PBO {
+public:
+  PBO() { glGenBuffers(1, &m_pbo); }
+  ~PBO() {
+    if (m_pbo != 0) {
+      GetGLState().DeleteBuffer(m_pbo);
+    }
+  }
+  NEVER_COPY(PBO);
+  PBO(PBO &&other) : m_pbo{other.m_pbo} { other.m_pbo = 0; };
+
+  void BufferData(GLsizeiptr size, const void *data, GLenum usage) const {
+    BindBuffer();
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, data, usage);
+  };
+  void BindBuffer() const {
+    GetGLState().BindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+  }
+  void Unbind() const { GetGLState().BindBuffer(GL_PIXEL_PACK_BUFFER, 0); }
+
+private:
+  GLuint m_pbo;
+};
+
 class FBO {
 public:
   FBO() { glGenFramebuffers(1, &m_fbo); }
   ~FBO() {
     if (m_fbo != 0) {
-      glDeleteFramebuffers(1, &m_fbo);
+      GetGLState().DeleteFramebuffer(m_fbo);
     }
   }
   NEVER_COPY(FBO);
   FBO(FBO &&other) : m_fbo{other.m_fbo} { other.m_fbo = 0; };
 
   void BindFramebuffer(GLenum target) const {
-    glBindFramebuffer(target, m_fbo);
+    GetGLState().BindFramebuffer(target, m_fbo);
+  }
+  void UnbindFramebuffer(GLenum target) const {
+    GetGLState().BindFramebuffer(target, 0);
   }
-  void UnbindFramebuffer(GLenum target) const { glBindFramebuffer(target, 0); }
   GLenum CheckFramebufferStatus(GLenum target) const {
     return glCheckFramebufferStatus(target);
   }
@@ -179,7 +250,7 @@ public:
   RPTexture() { glGenTextures(1, &m_texture); }
   ~RPTexture() {
     if (m_texture != 0) {
-      glDeleteTextures(1, &m_texture);
+      GetGLState().DeleteTexture(m_texture);
     }
   }
   NEVER_COPY(RPTexture);
@@ -187,7 +258,10 @@ public:
     other.m_texture = 0;
   };
 
-  void BindTexture(GLenum target) const { glBindTexture(target, m_texture); }
+  // to the active texture unit
+  void BindTexture(GLenum target) const {
+    GetGLState().BindTexture(target, m_texture);
+  }
   void FramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget,
                             GLint level) const {
     glFramebufferTexture2D(target, attachment, textarget, m_texture, level);
@@ -197,187 +271,273 @@ private:
   GLuint m_texture;
 };
 
+// Texture of a RenderGraph, valid for the frame it was declared in
+typedef GLuint RGResource;
+
+// How passes sample a transient texture
+enum RGSampler { RGS_NEAREST, RGS_LINEAR, RGS_SHADOW };
+
+// Render target that only lives within a frame. Transient textures with
+// the same description share storage when their passes do not overlap.
+struct RGTextureDesc {
+  GLsizei width;
+  GLsizei height;
+  // sized format; depth formats become the depth attachment
+  GLenum internal_format;
+  RGSampler sampler;
+};
+
+// Texture a pass samples
+struct RGRead {
+  RGResource resource;
+  // the graph binds it here before the pass runs, unless this is
+  // RenderGraph::kNoUnit and the pass binds it itself
+  GLuint unit;
+};
+
+// Fixed-function state the graph sets before a pass runs
+struct RGState {
+  bool depth_test;
+  bool cull_face;
+  // GL_BACK, GL_FRONT or GL_FRONT_AND_BACK, only set with cull_face
+  GLenum cull_mode;
+  // winding of front faces, GL_CCW or GL_CW, only set with cull_face
+  GLenum front_face;
+};
+
+struct RGPass {
+  std::string name;
+  std::vector<RGRead> reads;
+  // What the pass draws into: a transient texture, the backbuffer, or
+  // RenderGraph::kNoTarget for passes that set up their own framebuffer.
+  // The first pass drawing into a target clears it.
+  RGResource target;
+  // written without being the target, like storage the pass fills itself
+  std::vector<RGResource> writes;
+  RGState state;
+  // disabled passes are dropped, along with the passes only they needed
+  bool enabled;
+  // kept even if no pass reads what it writes
+  bool side_effects;
+  std::function<void()> execute;
+};
+
+// uFrameBlock of shaders/frame.glsl, std140 layout
+struct FrameBlock {
+  glm::mat4 view_projection;
+  glm::mat4 light_view_projection;
+  glm::vec4 camera_pos;
+  glm::vec4 ambient_light_color;
+  glm::vec4 light_dir;
+  glm::vec4 light_color;
+  float specular_power;
+  float shininess_scale;
+  // std140 aligns structs to 16 bytes and pads their size to match
+  float pad0[2];
+  TextureTileConfig tile_config;
+  float pad1[3];
+};
+static_assert(sizeof(FrameBlock) == 272, "FrameBlock must match std140");
+
+// uDrawBlock of shaders/frame.glsl, std140 layout
+struct DrawBlock {
+  glm::mat4 model_matrix;
+  glm::vec4 position_offset;
+  glm::vec4 position_scale;
+};
+
+// glBufferStorageEXT from GL_EXT_buffer_storage
+typedef void (*BufferStorage)(GLenum target, GLsizeiptr size,
+                              const void *data, GLbitfield flags);
+
+// Buffer for data the CPU rewrites every frame. It is a ring of one region
+// per frame in flight: each frame writes the region the GPU finished with
+// kFramesInFlight frames ago, which a fence confirms, so writing never
+// waits on draws still reading newer data. The buffer stays mapped where
+// GL_EXT_buffer_storage allows, otherwise each write maps its range
+// unsynchronized.
+class RPStreamBuffer {
+public:
+  static const GLuint kFramesInFlight = 3;
+  RPStreamBuffer(GLsizeiptr frame_size);
+  ~RPStreamBuffer();
+  NEVER_COPY(RPStreamBuffer);
+  RPStreamBuffer(RPStreamBuffer &&other);
+  // Moves on to the next region. Only blocks if the GPU is more than
+  // kFramesInFlight frames behind.
+  void BeginFrame();
+  // Fences everything written since BeginFrame
+  void EndFrame();
+  // Copies data into this frame's region at a multiple of alignment.
+  // Returns its offset in the buffer, or -1 if the region is full.
+  GLintptr Write(const void *data, GLsizeiptr size, GLuint alignment);
+  void BindBufferRange(GLenum target, GLuint index, GLintptr offset,
+                       GLsizeiptr size) const {
+    GetGLState().BindBufferRange(target, index, m_buffer, offset, size);
+  };
+  // BeginFrame calls that had to wait for the GPU
+  GLuint GetNumStalls() const { return m_num_stalls; };
+
+private:
+  GLuint m_buffer{0};
+  GLsizeiptr m_frame_size;
+  // persistent mapping of the whole buffer, if any
+  char *m_mapping{nullptr};
+  // region being written and the bytes used in it
+  GLuint m_frame{0};
+  GLsizeiptr m_frame_used{0};
+  GLsync m_fences[kFramesInFlight]{};
+  GLuint m_num_stalls{0};
+};
+
+// The uniform blocks every mesh and terrain program shares. The frame
+// block and all of a frame's draw blocks are streamed together once per
+// frame and stay bound at fixed binding points, so drawing an object only
+// selects its range of the buffer.
+class RPFrame {
+public:
+  RPFrame();
+  NEVER_COPY(RPFrame);
+  RPFrame(RPFrame &&other)
+      : m_stream{other.m_stream}, m_data{std::move(other.m_data)},
+        m_offset{other.m_offset}, m_alignment{other.m_alignment},
+        m_draw_offset{other.m_draw_offset},
+        m_draw_stride{other.m_draw_stride} {};
+  // Writes frame and draws to stream and binds the frame block
+  void Update(RPStreamBuffer &stream, const FrameBlock &frame,
+              const std::vector<DrawBlock> &draws);
+  // Binds draws[draw] of the last Update as the draw block
+  void BindDraw(GLuint draw) const;
+
+private:
+  const RPStreamBuffer *m_stream{nullptr};
+  // staging copy of the blocks, written to the stream in one piece
+  std::vector<char> m_data{};
+  // of m_data in the stream, -1 if it did not fit
+  GLintptr m_offset{-1};
+  GLuint m_alignment{1};
+  // draw blocks start at offsets the driver can bind
+  GLuint m_draw_offset{0};
+  GLuint m_draw_stride{0};
+  // set with layout(binding) in shaders/frame.glsl
+  const GLuint m_frame_block_binding{0};
+  const GLuint m_draw_block_binding{1};
+};
+
+// Shading variants, from cheapest to the full quality
+enum ShaderQuality { SQ_LOW, SQ_MEDIUM, SQ_HIGH, SQ_COUNT };
+
+// Defines of the lit shaders for quality; the shaders default to SQ_HIGH
+inline std::vector<ShaderDefine> GetQualityDefines(ShaderQuality quality) {
+  switch (quality) {
+  case SQ_LOW:
+    return {{"SHADOW_PCF_RADIUS", "0"}, {"TERRAIN_COLOR_VARIATION", "0"}};
+  case SQ_MEDIUM:
+    return {{"SHADOW_PCF_RADIUS", "1"}};
+  default:
+    return {};
+  }
+}
+
+// Vertex shaders skip everything but the position
+inline std::vector<ShaderDefine> GetDepthOnlyDefines() {
+  return {{"DEPTH_ONLY", "1"}};
+}
+
+// Depth only, from the light's view-projection
+inline std::vector<ShaderDefine> GetShadowDefines() {
+  return {{"DEPTH_ONLY", "1"}, {"LIGHT_VIEW", "1"}};
+}
+
 class RPMaterialShader {
 public:
-  RPMaterialShader()
-      : m_shader{"shaders/vertex.glsl", "shaders/fragment.glsl"},
-        m_depth_shader{"shaders/vertex.glsl",
-                       "shaders/depth_map_fragment.glsl"} {
-    m_shader.UseProgram();
-    m_shader.UniformBlockBinding("uMaterialBlock", m_material_block_binding);
-    m_shader.Uniform1i("uDepthTexture", m_depth_texture);
-
-    glUseProgram(0);
+  RPMaterialShader(ShaderLibrary &library)
+      : m_shadow_shader{library, "shaders/vertex.glsl",
+                        "shaders/depth_map_fragment.glsl",
+                        GetShadowDefines()} {
+    // every variant is submitted now so switching never waits on a compile
+    for (int quality = 0; quality < SQ_COUNT; quality++) {
+      m_shaders.emplace_back(library, "shaders/vertex.glsl",
+                             "shaders/fragment.glsl",
+                             GetQualityDefines((ShaderQuality)quality));
+    }
   };
   NEVER_COPY(RPMaterialShader);
   RPMaterialShader(RPMaterialShader &&other)
-      : m_shader{std::move(other.m_shader)},
-        m_depth_shader{std::move(other.m_depth_shader)},
-        m_depth_texture{other.m_depth_texture},
+      : m_shaders{std::move(other.m_shaders)},
+        m_shadow_shader{std::move(other.m_shadow_shader)},
+        m_quality{other.m_quality}, m_depth_texture{other.m_depth_texture},
         m_material_block_binding{other.m_material_block_binding} {};
-  void Begin() {
-    m_shader.UseProgram();
-    glGetBooleanv(GL_DEPTH_TEST, &g_depth_test);
-    glGetBooleanv(GL_CULL_FACE, &g_cull_face);
-    glGetIntegerv(GL_CULL_FACE_MODE, &g_cull_face_mode);
-    glGetIntegerv(GL_FRONT_FACE, &g_front_face);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glFrontFace(GL_CCW);
-  }
-  void BeginDepth() { m_depth_shader.UseProgram(); }
-  void EndDepth() { glUseProgram(0); }
-  void SetUniforms(const glm::vec3 &camera_pos, const Light &light,
-                   const glm::mat4 &mvp, const glm::mat4 &light_mvp,
-                   const glm::mat4 &model_matrix) const {
-    m_shader.Uniform3fv("uCameraPos", camera_pos);
-    m_shader.Uniform3fv("uAmbientLightColor", light.ambient_color);
-    m_shader.Uniform3fv("uLightDir", light.direction);
-    m_shader.Uniform3fv("uLightColor", light.diffuse_color);
-    m_shader.UniformMatrix4fv("uMVP", GL_FALSE, mvp);
-    m_shader.UniformMatrix4fv("uLightMVP", GL_FALSE, light_mvp);
-    m_shader.UniformMatrix4fv("uModelMatrix", GL_FALSE, model_matrix);
-    m_shader.Uniform1f("uSpecularPower", 32.0f);
-    m_shader.Uniform1f("uShininessScale", 2000.0f);
-  }
-  void SetDepthUniforms(const glm::mat4 &mvp, const glm::mat4 &light_mvp,
-                        const glm::mat4 &model_matrix) const {
-    m_depth_shader.UniformMatrix4fv("uMVP", GL_FALSE, mvp);
-    m_depth_shader.UniformMatrix4fv("uLightMVP", GL_FALSE, light_mvp);
-    m_depth_shader.UniformMatrix4fv("uModelMatrix", GL_FALSE, model_matrix);
-  }
-  void BindMaterialsBuffer(const UBO &ubo) const {
-    ubo.BindBufferBase(m_material_block_binding);
+  void SetQuality(ShaderQuality quality) { m_quality = quality; }
+  // Depth test and culling come from the pass's RGState
+  void Begin() { m_shaders[m_quality].UseProgram(); }
+  void BeginShadow() { m_shadow_shader.UseProgram(); }
+  void EndShadow() {}
+  void BindMaterialsBuffer(const SSBO &ssbo) const {
+    ssbo.BindBufferBase(m_material_block_binding);
   }
   void BindTexture(const RPTexture &texture,
                    const GLuint texture_location) const {
-    glActiveTexture(GL_TEXTURE0 + texture_location);
+    GetGLState().ActiveTexture(GL_TEXTURE0 + texture_location);
     texture.BindTexture(GL_TEXTURE_2D);
   }
   void BindDepthTexture(const RPTexture &texture) const {
     BindTexture(texture, m_depth_texture);
   }
-  void End() {
-    if (g_depth_test == GL_FALSE)
-      glDisable(GL_DEPTH_TEST);
-    if (g_cull_face == GL_FALSE)
-      glDisable(GL_CULL_FACE);
-    glCullFace(g_cull_face_mode);
-    glFrontFace(g_front_face);
-    glUseProgram(0);
-  }
+  GLuint GetDepthTextureUnit() const { return m_depth_texture; }
+  // The program stays bound, the next pass's UseProgram replaces it
+  void End() {}
 
 private:
-  Shader m_shader;
-  Shader m_depth_shader;
+  // indexed by ShaderQuality
+  std::vector<Shader> m_shaders{};
+  Shader m_shadow_shader;
+  ShaderQuality m_quality{SQ_HIGH};
+  // texture unit and storage block, set with layout(binding) in the shader
   const GLuint m_depth_texture{0};
-  const GLuint m_material_block_binding{0};
-  GLboolean g_depth_test, g_cull_face;
-  GLint g_cull_face_mode, g_front_face;
+  const GLuint m_material_block_binding{3};
 };
 
 class RPTerrainShader {
 public:
-  RPTerrainShader()
-      : m_shader{"shaders/terrain_vertex.glsl",
-                 "shaders/terrain_fragment.glsl"},
-        m_depth_shader{"shaders/terrain_vertex.glsl",
-                       "shaders/depth_map_fragment.glsl"},
-        m_depth_skirt_shader{"shaders/terrain_skirt_vertex.glsl",
-                             "shaders/depth_map_fragment.glsl"} {
-
-    m_tile_config_ubo.BufferData(sizeof(TextureTileConfig), NULL,
-                                 GL_DYNAMIC_DRAW);
-
-    m_shader.UseProgram();
-    m_shader.UniformBlockBinding("uMaterialBlock", m_material_block_binding);
-    m_shader.UniformBlockBinding("uTileConfigBlock",
-                                 m_tile_config_block_binding);
-    m_shader.Uniform1i("uDepthTexture", m_depth_texture);
-    m_shader.Uniform1i("uNoiseTexture", m_noise_texture);
-    m_shader.Uniform1i("uHeightmapTexture", m_heightmap_texture);
-    m_shader.Uniform1i("uBlendTexture", m_blend_texture);
-
-    m_depth_shader.UseProgram();
-    m_depth_shader.UniformBlockBinding("uTileConfigBlock",
-                                       m_tile_config_block_binding);
-    m_depth_shader.Uniform1i("uHeightmapTexture", m_heightmap_texture);
-
-    m_depth_skirt_shader.UseProgram();
-    m_depth_skirt_shader.UniformBlockBinding("uTileConfigBlock",
-                                             m_tile_config_block_binding);
-    m_depth_skirt_shader.Uniform1i("uHeightmapTexture", m_heightmap_texture);
-
-    glUseProgram(0);
+  RPTerrainShader(ShaderLibrary &library)
+      : m_depth_shader{library, "shaders/terrain_vertex.glsl",
+                       "shaders/depth_map_fragment.glsl",
+                       GetDepthOnlyDefines()},
+        m_shadow_shader{library, "shaders/terrain_vertex.glsl",
+                        "shaders/depth_map_fragment.glsl",
+                        GetShadowDefines()},
+        m_shadow_skirt_shader{library, "shaders/terrain_skirt_vertex.glsl",
+                              "shaders/depth_map_fragment.glsl",
+                              {{"LIGHT_VIEW", "1"}}} {
+    for (int quality = 0; quality < SQ_COUNT; quality++) {
+      m_shaders.emplace_back(library, "shaders/terrain_vertex.glsl",
+                             "shaders/terrain_fragment.glsl",
+                             GetQualityDefines((ShaderQuality)quality));
+    }
   };
   NEVER_COPY(RPTerrainShader);
   RPTerrainShader(RPTerrainShader &&other)
-      : m_shader{std::move(other.m_shader)},
+      : m_shaders{std::move(other.m_shaders)},
         m_depth_shader{std::move(other.m_depth_shader)},
-        m_depth_skirt_shader{std::move(other.m_depth_skirt_shader)},
-        m_tile_config_ubo{std::move(other.m_tile_config_ubo)},
-        m_depth_texture{other.m_depth_texture},
+        m_shadow_shader{std::move(other.m_shadow_shader)},
+        m_shadow_skirt_shader{std::move(other.m_shadow_skirt_shader)},
+        m_quality{other.m_quality}, m_depth_texture{other.m_depth_texture},
         m_noise_texture{other.m_noise_texture},
         m_heightmap_texture{other.m_heightmap_texture},
-        m_material_block_binding{other.m_material_block_binding},
-        m_tile_config_block_binding{other.m_tile_config_block_binding} {};
-  void Begin() {
-    m_shader.UseProgram();
-    glGetBooleanv(GL_DEPTH_TEST, &g_depth_test);
-    glGetBooleanv(GL_CULL_FACE, &g_cull_face);
-    glGetIntegerv(GL_CULL_FACE_MODE, &g_cull_face_mode);
-    glGetIntegerv(GL_FRONT_FACE, &g_front_face);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glFrontFace(GL_CCW);
-  }
-  void End() {
-    if (g_depth_test == GL_FALSE)
-      glDisable(GL_DEPTH_TEST);
-    if (g_cull_face == GL_FALSE)
-      glDisable(GL_CULL_FACE);
-    glCullFace(g_cull_face_mode);
-    glFrontFace(g_front_face);
-    glUseProgram(0);
-  }
+        m_material_block_binding{other.m_material_block_binding} {};
+  void SetQuality(ShaderQuality quality) { m_quality = quality; }
+  void Begin() { m_shaders[m_quality].UseProgram(); }
+  void End() {}
+  // from the camera, for the Hi-Z occluders
   void BeginDepth() { m_depth_shader.UseProgram(); }
-  void EndDepth() { glUseProgram(0); }
-  void BeginDepthSkirt() { m_depth_skirt_shader.UseProgram(); }
-  void EndDepthSkirt() { glUseProgram(0); }
-  void SetUniforms(const glm::vec3 &camera_pos, const Light &light,
-                   const TextureTileConfig &tileConfig, const glm::mat4 &mvp,
-                   const glm::mat4 &light_mvp,
-                   const glm::mat4 &model_matrix) const {
-    m_shader.Uniform3fv("uCameraPos", camera_pos);
-    m_shader.Uniform3fv("uAmbientLightColor", light.ambient_color);
-    m_shader.Uniform3fv("uLightDir", light.direction);
-    m_shader.Uniform3fv("uLightColor", light.diffuse_color);
-    m_shader.UniformMatrix4fv("uMVP", GL_FALSE, mvp);
-    m_shader.UniformMatrix4fv("uLightMVP", GL_FALSE, light_mvp);
-    m_shader.UniformMatrix4fv("uModelMatrix", GL_FALSE, model_matrix);
-    m_shader.Uniform1f("uSpecularPower", 32.0f);
-    m_shader.Uniform1f("uShininessScale", 2000.0f);
-
-    m_tile_config_ubo.BufferSubData(0, sizeof(tileConfig), &tileConfig);
-    m_tile_config_ubo.BindBufferBase(m_tile_config_block_binding);
-  }
-  void SetDepthUniforms(const TextureTileConfig &tileConfig,
-                        const glm::mat4 &mvp, const glm::mat4 &model_matrix) {
-    m_depth_shader.UniformMatrix4fv("uMVP", GL_FALSE, mvp);
-    m_depth_shader.UniformMatrix4fv("uModelMatrix", GL_FALSE, model_matrix);
-    m_tile_config_ubo.BufferSubData(0, sizeof(tileConfig), &tileConfig);
-    m_tile_config_ubo.BindBufferBase(m_tile_config_block_binding);
-  };
-  void setDepthSkirtUniforms(const TextureTileConfig &tileConfig,
-                             const glm::mat4 &mvp) {
-    m_depth_skirt_shader.UniformMatrix4fv("uMVP", GL_FALSE, mvp);
-    m_tile_config_ubo.BufferSubData(0, sizeof(tileConfig), &tileConfig);
-    m_tile_config_ubo.BindBufferBase(m_tile_config_block_binding);
-  };
-  void BindMaterialsBuffer(const UBO &ubo) const {
-    ubo.BindBufferBase(m_material_block_binding);
+  void EndDepth() {}
+  void BeginShadow() { m_shadow_shader.UseProgram(); }
+  void EndShadow() {}
+  void BeginShadowSkirt() { m_shadow_skirt_shader.UseProgram(); }
+  void EndShadowSkirt() {}
+  void BindMaterialsBuffer(const SSBO &ssbo) const {
+    ssbo.BindBufferBase(m_material_block_binding);
   }
   void BindDepthTexture(const RPTexture &texture) const {
     BindTexture(texture, m_depth_texture);
@@ -391,96 +551,342 @@ public:
   void BindBlendTexture(const RPTexture &texture) const {
     Bind2DArrayTexture(texture, m_blend_texture);
   }
+  GLuint GetDepthTextureUnit() const { return m_depth_texture; }
+  GLuint GetNoiseTextureUnit() const { return m_noise_texture; }
+  GLuint GetHeightmapTextureUnit() const { return m_heightmap_texture; }
+  GLuint GetBlendTextureUnit() const { return m_blend_texture; }
 
 private:
-  Shader m_shader;
+  // indexed by ShaderQuality
+  std::vector<Shader> m_shaders{};
   Shader m_depth_shader;
-  Shader m_depth_skirt_shader;
-  UBO m_tile_config_ubo;
+  Shader m_shadow_shader;
+  Shader m_shadow_skirt_shader;
+  ShaderQuality m_quality{SQ_HIGH};
+  // texture units and blocks, set with layout(binding) in the shaders
   const GLuint m_depth_texture{0};
   const GLuint m_noise_texture{2};
   const GLuint m_heightmap_texture{3};
   const GLuint m_blend_texture{4};
-  const GLuint m_material_block_binding{0};
-  const GLuint m_tile_config_block_binding{1};
-
-  GLboolean g_depth_test, g_cull_face;
-  GLint g_cull_face_mode, g_front_face;
+  const GLuint m_material_block_binding{3};
 
   void BindTexture(const RPTexture &texture,
                    const GLuint texture_location) const {
-    glActiveTexture(GL_TEXTURE0 + texture_location);
+    GetGLState().ActiveTexture(GL_TEXTURE0 + texture_location);
     texture.BindTexture(GL_TEXTURE_2D);
   }
   void Bind2DArrayTexture(const RPTexture &texture,
                           const GLuint texture_location) const {
-    glActiveTexture(GL_TEXTURE0 + texture_location);
+    GetGLState().ActiveTexture(GL_TEXTURE0 + texture_location);
     texture.BindTexture(GL_TEXTURE_2D_ARRAY);
   }
 };
 
+class RPHiZ;
+
+// Where a pass looks from, for culling meshes against its frustum and
+// choosing mesh LODs by projected error
+struct PassView {
+  glm::mat4 view_projection;
+  glm::mat4 model_matrix;
+  glm::vec3 eye_position;
+  // pixels per unit of object size at distance 1
+  float projection_scale;
+  float pixel_error;
+  // optional occluder depth pyramid matching this view
+  const RPHiZ *occlusion;
+};
+
+struct DrawStats {
+  GLuint meshes{0};
+  GLuint draw_calls{0};
+  GLuint triangles{0};
+  DrawStats &operator+=(const DrawStats &other) {
+    meshes += other.meshes;
+    draw_calls += other.draw_calls;
+    triangles += other.triangles;
+    return *this;
+  };
+};
+
+// Instances are split into spatially compact buckets. Culling and LODs
+// treat the instances of a bucket as one sphere around its pivot instance,
+// grown to enclose every other copy in it. Also the std430 layout of
+// InstanceBucket in shaders/cull_compute.glsl.
+struct InstanceBucket {
+  glm::mat4 pivot{1.0f};
+  // farthest translation of any instance in the bucket from the pivot
+  float spread{0.0f};
+  // largest scale of any instance transform in the bucket
+  float scale{1.0f};
+  // the bucket's range of the instance buffer
+  GLuint first_instance{0};
+  GLuint num_instances{0};
+};
+static_assert(sizeof(InstanceBucket) == 80,
+              "InstanceBucket must match std430");
+
+// Per-mesh input of shaders/cull_compute.glsl, std430 layout
+struct CullMesh {
+  glm::vec4 sphere;
+  glm::vec4 extent;
+  glm::uvec4 lod_offsets;
+  glm::uvec4 lod_counts;
+  glm::vec4 lod_errors;
+  GLuint node_idx;
+  GLuint num_lods;
+  GLuint pad[2];
+};
+static_assert(sizeof(CullMesh) == 96, "CullMesh must match std430");
+static_assert(kMaxMeshLods == 4, "CullMesh stores LODs in vec4s");
+
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint reserved_must_be_zero;
+};
+
+// GPU-driven culling: one compute invocation per instance bucket and mesh
+// writes that pair's DrawElementsIndirectCommand, empty if it is culled.
+// Commands are ordered by bucket, then mesh.
+class RPCullShader {
+public:
+  RPCullShader(ShaderLibrary &library)
+      : m_shader{library, "shaders/cull_compute.glsl"} {};
+  NEVER_COPY(RPCullShader);
+  RPCullShader(RPCullShader &&other)
+      : m_shader{std::move(other.m_shader)},
+        m_hiz_texture{other.m_hiz_texture},
+        m_mesh_block_binding{other.m_mesh_block_binding},
+        m_node_block_binding{other.m_node_block_binding},
+        m_command_block_binding{other.m_command_block_binding},
+        m_bucket_block_binding{other.m_bucket_block_binding} {};
+  void Dispatch(const PassView &view, GLuint num_meshes, GLuint num_buckets,
+                const SSBO &meshes, const SSBO &nodes, const SSBO &buckets,
+                const SSBO &commands) const;
+
+private:
+  Shader m_shader;
+  // set with layout(binding) in the shader
+  const GLuint m_hiz_texture{1};
+  const GLuint m_mesh_block_binding{0};
+  const GLuint m_node_block_binding{1};
+  const GLuint m_command_block_binding{2};
+  // 3 is the material block of the lit passes
+  const GLuint m_bucket_block_binding{4};
+};
+
+// glMultiDrawElementsIndirectEXT from GL_EXT_multi_draw_indirect
+typedef void (*MultiDrawElementsIndirect)(GLenum mode, GLenum type,
+                                          const void *indirect,
+                                          GLsizei draw_count, GLsizei stride);
+
 class RPMaterial {
 public:
-  RPMaterial(const std::vector<Material> &materials,
-             const std::vector<MeshVertexBuffer> &vertex_buffer_data,
-             const std::vector<GLuint> &element_buffer_data);
+  // Adds the group's materials to materials; its vertices are rewritten to
+  // index the table when that differs from the group's own numbering. The
+  // table must stay within kMaxVertexMaterials, see
+  // MaterialTable::CanAddGroup.
+  // Streamed buffers are only allocated here and filled by UploadBuffers,
+  // otherwise everything is uploaded right away.
+  RPMaterial(const MeshBuffers &buffers, MaterialTable &materials,
+             bool is_streamed = false);
   NEVER_COPY(RPMaterial);
   RPMaterial(RPMaterial &&other)
-      : m_vao{std::move(other.m_vao)}, m_ubo{std::move(other.m_ubo)},
-        m_vbo{std::move(other.m_vbo)}, m_ebo{std::move(other.m_ebo)},
-        m_num_elements{other.m_num_elements} {};
-
-  void DrawVertices() const;
-  const UBO &GetMaterialsBuffer() const { return m_ubo; };
+      : m_vao{std::move(other.m_vao)}, m_vbo{std::move(other.m_vbo)},
+        m_ebo{std::move(other.m_ebo)},
+        m_num_elements{other.m_num_elements},
+        m_num_vertices{other.m_num_vertices},
+        m_num_uploaded_elements{other.m_num_uploaded_elements},
+        m_num_uploaded_vertices{other.m_num_uploaded_vertices},
+        m_material_indices{std::move(other.m_material_indices)},
+        m_element_type{other.m_element_type},
+        m_vertex_decode{other.m_vertex_decode},
+        m_mesh_map{std::move(other.m_mesh_map)},
+        m_instance_vbo{std::move(other.m_instance_vbo)},
+        m_num_instances{other.m_num_instances},
+        m_instance_buckets{std::move(other.m_instance_buckets)},
+        m_bucket_ssbo{std::move(other.m_bucket_ssbo)},
+        m_cull_mesh_ssbo{std::move(other.m_cull_mesh_ssbo)},
+        m_node_ssbo{std::move(other.m_node_ssbo)},
+        m_command_ssbo{std::move(other.m_command_ssbo)},
+        m_node_runs{std::move(other.m_node_runs)},
+        m_multi_draw_indirect{other.m_multi_draw_indirect} {};
+
+  // Uploads the next at most max_bytes of vertices, then elements, from the
+  // buffers the RPMaterial was created with. Returns the bytes uploaded.
+  GLsizeiptr UploadBuffers(const MeshBuffers &buffers, GLsizeiptr max_bytes);
+  // Replaces the fully uploaded old_buffers with buffers, re-importing
+  // the same file. Buffers that kept their size are patched in place where
+  // their contents differ, the others are reallocated. Returns the bytes
+  // uploaded.
+  GLsizeiptr Reload(const MeshBuffers &old_buffers, const MeshBuffers &buffers,
+                    MaterialTable &materials);
+  // Nothing may be drawn before this
+  bool IsUploaded() const {
+    return m_num_uploaded_vertices == m_num_vertices &&
+           m_num_uploaded_elements == m_num_elements;
+  };
+  // Every draw is repeated once per instance transform, in both the depth
+  // and the colour pass. Starts out as a single identity instance. The
+  // instances are regrouped into InstanceBuckets of nearby copies.
+  void SetInstances(const glm::mat4 *transforms, GLuint num_instances);
+  GLuint GetNumInstances() const { return m_num_instances; };
+  // Each mesh is placed by the world matrix of its node, see
+  // TransformHierarchy.
+  DrawStats DrawVertices(const std::vector<glm::mat4> &node_matrices) const;
+  // Per instance bucket, skips meshes outside view's frustum and draws the
+  // rest at the coarsest LOD whose error stays under view.pixel_error on
+  // screen for the bucket's nearest instance. Contiguous visible ranges are
+  // merged into one draw.
+  DrawStats DrawVisible(const PassView &view,
+                        const std::vector<glm::mat4> &node_matrices) const;
+  // GPU-driven DrawVisible: culling and LOD selection run in a compute pass
+  // and the draws are submitted indirectly, one multi-draw per instance
+  // bucket and node. Only draw_calls is counted. Needs
+  // GL_EXT_multi_draw_indirect, without it this is DrawVisible.
+  DrawStats DrawIndirect(const RPCullShader &cull_shader, const PassView &view,
+                         const std::vector<glm::mat4> &node_matrices) const;
+  // Uploads the node world matrices DrawIndirect culls with
+  void SetNodeMatrices(const std::vector<glm::mat4> &node_matrices) const;
+  const VertexDecode &GetVertexDecode() const { return m_vertex_decode; };
 
 private:
+  // meshes [first_mesh, first_mesh + num_meshes) all belong to node_idx
+  struct NodeRun {
+    GLuint first_mesh;
+    GLuint num_meshes;
+    GLuint node_idx;
+  };
+  void AddMaterials(const MeshBuffers &buffers, MaterialTable &materials);
+  // mesh map, node runs and the GPU culling inputs
+  void SetMeshes(const MeshBuffers &buffers);
+  // one indirect command per instance bucket and mesh
+  void AllocateCommands();
+  // Points the instance attributes at the instance buffer from
+  // first_instance on. ES has no base instance for draws.
+  void BindInstances(GLuint first_instance) const;
+  // Draws the instances of bucket. select_lod returns the LOD to draw a
+  // mesh at, or -1 to skip it.
+  DrawStats DrawMeshes(const std::vector<glm::mat4> &node_matrices,
+                       const InstanceBucket &bucket,
+                       const std::function<GLint(GLuint)> &select_lod) const;
   VAO m_vao;
-  UBO m_ubo;
   VBO m_vbo;
   EBO m_ebo;
   GLuint m_num_elements{0};
+  GLuint m_num_vertices{0};
+  GLuint m_num_uploaded_elements{0};
+  GLuint m_num_uploaded_vertices{0};
+  // table index of every group material, empty if they are the same
+  std::vector<GLuint> m_material_indices{};
+  GLenum m_element_type{GL_UNSIGNED_INT};
+  VertexDecode m_vertex_decode{};
+  std::vector<MeshMap> m_mesh_map{};
+  VBO m_instance_vbo;
+  GLuint m_num_instances{0};
+  std::vector<InstanceBucket> m_instance_buckets{};
+  // m_instance_buckets for the GPU culling pass
+  SSBO m_bucket_ssbo;
+  SSBO m_cull_mesh_ssbo;
+  SSBO m_node_ssbo;
+  SSBO m_command_ssbo;
+  std::vector<NodeRun> m_node_runs{};
+  MultiDrawElementsIndirect m_multi_draw_indirect{nullptr};
 };
 
+// Shadow map of the static light. The texture is a transient target of the
+// RenderGraph, drawn by the shadow passes and sampled by the lit ones.
 class RPDepthMap {
 public:
   RPDepthMap(GLuint texture_size);
   NEVER_COPY(RPDepthMap);
-  RPDepthMap(RPDepthMap &&other)
-      : m_fbo{std::move(other.m_fbo)}, m_texture{std::move(other.m_texture)},
-        m_texture_size{other.m_texture_size}, g_vp{other.g_vp},
-        g_depth_test{other.g_depth_test}, g_cull_face{other.g_cull_face} {};
+  RPDepthMap(RPDepthMap &&other) : m_texture_size{other.m_texture_size} {};
   glm::mat4 GetProjection(float fov, float near, float far) const;
-  void Begin();
-  void End();
-  const RPTexture &GetTexture() const;
+  RGTextureDesc GetTextureDesc() const;
 
 private:
-  FBO m_fbo;
-  RPTexture m_texture;
   GLuint m_texture_size{0};
-  glm::ivec4 g_vp{};
-  GLboolean g_depth_test, g_cull_face;
-  GLint g_cull_face_mode, g_front_face;
+};
+
+// Hierarchical-Z occlusion culling. Large occluders are rendered into a
+// small transient depth target, reduced into a pyramid of farthest depths
+// and read back asynchronously. Meshes are tested against the newest
+// pyramid the GPU has finished, usually last frame's, so culling never
+// waits on the GPU.
+class RPHiZ {
+public:
+  RPHiZ(ShaderLibrary &library);
+  ~RPHiZ();
+  NEVER_COPY(RPHiZ);
+  RPHiZ(RPHiZ &&other)
+      : m_shader{std::move(other.m_shader)}, m_vao{std::move(other.m_vao)},
+        m_pyramid_fbo{std::move(other.m_pyramid_fbo)},
+        m_pyramid_texture{std::move(other.m_pyramid_texture)},
+        m_readback_pbo{std::move(other.m_readback_pbo)},
+        m_readback_fence{other.m_readback_fence},
+        m_readback_view_projection{other.m_readback_view_projection},
+        m_pyramid_view_projection{other.m_pyramid_view_projection},
+        m_view_projection{other.m_view_projection},
+        m_levels{std::move(other.m_levels)},
+        m_texture_binding{other.m_texture_binding} {
+    other.m_readback_fence = 0;
+  };
+  // Collects the pyramid of an earlier BuildPyramid if the GPU is done
+  // with it. Never blocks.
+  void Update();
+  // Target of the occluder depth pass, drawn with the camera's
+  // view-projection
+  RGTextureDesc GetDepthDesc() const;
+  // Reduces the occluder depth into the pyramid and starts reading it
+  // back. Expects depth testing off, leaves its own framebuffer bound.
+  void BuildPyramid(const glm::mat4 &view_projection, const RPTexture &depth);
+  // True if the world-space box is behind the occluders of the newest
+  // pyramid that has been read back
+  bool IsOccluded(const glm::vec3 &center, const glm::vec3 &extent) const;
+  // The pyramid of the last BuildPyramid, for culling on the GPU where it
+  // can be read without waiting
+  const RPTexture &GetPyramidTexture() const { return m_pyramid_texture; };
+  const glm::mat4 &GetPyramidViewProjection() const {
+    return m_pyramid_view_projection;
+  };
+  GLuint GetPyramidLevels() const;
+
+private:
+  Shader m_shader;
+  VAO m_vao;
+  FBO m_pyramid_fbo;
+  RPTexture m_pyramid_texture;
+  PBO m_readback_pbo;
+  GLsync m_readback_fence{0};
+  glm::mat4 m_readback_view_projection{1.0f};
+  glm::mat4 m_pyramid_view_projection{1.0f};
+  glm::mat4 m_view_projection{1.0f};
+  // CPU copy of the read back level and the coarser levels reduced from it
+  std::vector<std::vector<float>> m_levels{};
+  // set with layout(binding) in the shader
+  const GLuint m_texture_binding{1};
 };
 
 class RPTerrain {
 public:
-  RPTerrain();
+  RPTerrain(MaterialTable &materials);
   NEVER_COPY(RPTerrain);
   RPTerrain(RPTerrain &&other)
-      : m_vao{std::move(other.m_vao)}, m_ubo{std::move(other.m_ubo)} {};
+      : m_vao{std::move(other.m_vao)}, m_material_idx{other.m_material_idx} {};
   void DrawVertices(int num_vertices) const;
   void DrawSkirt(int resolution) const;
-  const UBO &GetMaterialsBuffer() const { return m_ubo; };
 
 private:
   VAO m_vao;
-  UBO m_ubo;
+  GLuint m_material_idx;
 };
 
 class RPIcon {
 public:
-  RPIcon();
+  RPIcon(ShaderLibrary &library);
   NEVER_COPY(RPIcon);
   RPIcon(RPIcon &&other)
       : m_shader{std::move(other.m_shader)}, m_vao{std::move(other.m_vao)} {};
@@ -493,7 +899,7 @@ private:
 
 class RPTex {
 public:
-  RPTex();
+  RPTex(ShaderLibrary &library);
   NEVER_COPY(RPTex);
   RPTex(RPTex &&other)
       : m_shader{std::move(other.m_shader)}, m_vao{std::move(other.m_vao)},
@@ -505,5 +911,72 @@ private:
   Shader m_shader;
   VAO m_vao;
   VBO m_vbo;
+  // set with layout(binding) in the shader
   const GLuint m_texture_binding{1};
-};
\ No newline at end of file
+};
+
+// Declarative frame: passes state the textures they read and the target
+// they draw into, and Execute works out the rest. Passes run once every
+// writer of what they read has run, passes nothing needs are culled,
+// transient targets are allocated from a pool where textures of the same
+// description are shared by passes that do not overlap, and each pass's
+// framebuffer, viewport, fixed-function state and textures are set before
+// it runs. Passes and resources are declared again every frame.
+class RenderGraph {
+public:
+  static const RGResource kBackbuffer = 0;
+  static const RGResource kNoTarget = 0xffffffff;
+  static const GLuint kNoUnit = 0xffffffff;
+  RenderGraph() = default;
+  NEVER_COPY(RenderGraph);
+  // Starts declaring a frame drawn to a backbuffer of size. Colour targets
+  // are cleared to clear_color before their first pass, depth to 1.
+  void Begin(const glm::ivec2 &size, const glm::vec4 &clear_color);
+  RGResource ImportTexture(const std::string &name, const RPTexture &texture,
+                           GLenum target = GL_TEXTURE_2D);
+  RGResource CreateTexture(const std::string &name, const RGTextureDesc &desc);
+  void AddPass(RGPass pass);
+  // Runs the passes of the frame and frees pooled textures it did not use.
+  // Leaves the backbuffer bound.
+  void Execute();
+  // Texture behind resource, for passes using it other than through a
+  // bound read. Transient textures only exist while Execute runs.
+  const RPTexture &GetTexture(RGResource resource) const;
+  // of the last Execute
+  GLuint GetNumExecuted() const { return m_num_executed; };
+  GLuint GetNumCulled() const { return m_num_culled; };
+  GLuint GetNumTargets() const { return m_targets.size(); };
+
+private:
+  struct Resource {
+    std::string name;
+    // nullptr for transient textures
+    const RPTexture *imported;
+    GLenum target;
+    RGTextureDesc desc;
+    // index in m_targets while Execute runs, -1 if not allocated
+    GLint physical;
+  };
+  // pooled storage of transient textures
+  struct Target {
+    RGTextureDesc desc;
+    RPTexture texture;
+    FBO fbo;
+    // position of the last pass using it in the running frame, -1 if none
+    GLint last_use;
+  };
+  // Passes in the order they run, without disabled or culled ones
+  std::vector<GLuint> Schedule();
+  void Allocate(const std::vector<GLuint> &order);
+  GLuint CreateTarget(const RGTextureDesc &desc);
+  // Binds target with a viewport covering it, cleared to m_clear_color
+  // first if clear
+  void BindTarget(RGResource target, bool clear) const;
+  std::vector<Resource> m_resources{};
+  std::vector<RGPass> m_passes{};
+  std::vector<Target> m_targets{};
+  glm::ivec2 m_size{0};
+  glm::vec4 m_clear_color{0.0f};
+  GLuint m_num_executed{0};
+  GLuint m_num_culled{0};
+};
@@ -1,71 +1,77 @@
-#include <filesystem>
+#include <algorithm>
 #include <iostream>
 
 #include "Shader.hpp"
-#include "utils.hpp"
 
-// expand #include directives
-std::string LoadShaderSource(const std::string &path) {
-  std::string src = LoadFileIntoString(path);
-  const std::filesystem::path file_path(path);
-  size_t replace_index;
-  while ((replace_index = src.find("#include")) != src.npos) {
-    size_t l_quote = src.find("\"", replace_index);
-    size_t r_quote = src.find("\"", l_quote + 1);
-    const std::string path = src.substr(l_quote + 1, r_quote - l_quote - 1);
-    const std::string path_source =
-        LoadShaderSource(file_path.parent_path() / path);
-    src.replace(replace_index, r_quote - replace_index + 1, path_source);
-  }
-  return src;
-}
-
-Shader::Shader(const char *vertex_path, const char *frag_path) {
-  const std::string vertex_source = LoadShaderSource(vertex_path);
-  const std::string frag_source = LoadShaderSource(frag_path);
-  const char *vert_c_str = vertex_source.c_str();
-  const char *frag_c_str = frag_source.c_str();
+Shader::Shader(ShaderLibrary &library, const char *vertex_path,
+               const char *frag_path,
+               const std::vector<ShaderDefine> &defines)
+    : m_library{&library} {
+  m_handle = library.CreateProgram(
+      {{GL_VERTEX_SHADER, vertex_path}, {GL_FRAGMENT_SHADER, frag_path}},
+      defines);
+};
 
-  const GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-  const GLuint frag_shader = glCreateShader(GL_FRAGMENT_SHADER);
+Shader::Shader(ShaderLibrary &library, const char *compute_path,
+               const std::vector<ShaderDefine> &defines)
+    : m_library{&library} {
+  m_handle =
+      library.CreateProgram({{GL_COMPUTE_SHADER, compute_path}}, defines);
+};
 
-  // compile shaders
-  const uint kLogBufferSize = 512;
-  int success;
-  char info_log[kLogBufferSize]{};
-  glShaderSource(vertex_shader, 1, &vert_c_str, nullptr);
-  glCompileShader(vertex_shader);
-  glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(vertex_shader, kLogBufferSize, NULL, info_log);
-    throw std::runtime_error("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" +
-                             std::string{info_log});
+void Shader::Reflect() const {
+  m_uniforms.clear();
+  m_blocks.clear();
+  GLint num_uniforms = 0;
+  GLint max_length = 0;
+  glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+  glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+  std::string name(max_length, '\0');
+  for (GLint i = 0; i < num_uniforms; i++) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(m_program, i, max_length, &length, &size, &type,
+                       name.data());
+    GLint location = glGetUniformLocation(m_program, name.c_str());
+    // members of uniform blocks have no location
+    if (location < 0) {
+      continue;
+    }
+    // arrays are reported as their first element
+    std::string_view base_name{name.data(), (size_t)length};
+    if (base_name.size() > 3 &&
+        base_name.substr(base_name.size() - 3) == "[0]") {
+      base_name.remove_suffix(3);
+    }
+    m_uniforms.push_back(
+        (Reflected){.hash = HashName(base_name), .location = location});
   }
-  glShaderSource(frag_shader, 1, &frag_c_str, nullptr);
-  glCompileShader(frag_shader);
-  glGetShaderiv(frag_shader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(frag_shader, kLogBufferSize, NULL, info_log);
-    glDeleteShader(vertex_shader);
-    throw std::runtime_error("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" +
-                             std::string{info_log});
+
+  GLint num_blocks = 0;
+  glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+  glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                 &max_length);
+  name.assign(max_length, '\0');
+  for (GLint i = 0; i < num_blocks; i++) {
+    GLsizei length = 0;
+    glGetActiveUniformBlockName(m_program, i, max_length, &length,
+                                name.data());
+    m_blocks.push_back(
+        (Reflected){.hash = HashName(std::string_view{name.data(),
+                                                      (size_t)length}),
+                    .location = i});
   }
 
-  // link program
-  m_program = glCreateProgram();
-  glAttachShader(m_program, vertex_shader);
-  glAttachShader(m_program, frag_shader);
-  glLinkProgram(m_program);
-  glGetProgramiv(m_program, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(m_program, kLogBufferSize, NULL, info_log);
-    glDeleteShader(vertex_shader);
-    glDeleteShader(frag_shader);
-    throw std::runtime_error("ERROR::SHADER::PROGRAM::LINKING_FAILED\n" +
-                             std::string{info_log});
+  for (std::vector<Reflected> *table : {&m_uniforms, &m_blocks}) {
+    std::sort(table->begin(), table->end(),
+              [](const Reflected &a, const Reflected &b) {
+                return a.hash < b.hash;
+              });
+    for (size_t i = 1; i < table->size(); i++) {
+      if ((*table)[i].hash == (*table)[i - 1].hash) {
+        std::cerr << "Uniform name hash collision, rename one." << std::endl;
+      }
+    }
   }
-  glDeleteShader(vertex_shader);
-  glDeleteShader(frag_shader);
-  std::cout << "Loaded shaders:" << vertex_path << ", " << frag_path
-            << std::endl;
 };
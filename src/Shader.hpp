@@ -1,79 +1,165 @@
 #pragma once
 
+#include "GLState.hpp"
+#include "ShaderLibrary.hpp"
 #include "gl.hpp"
 #include "utils.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
 #include <string>
+#include <string_view>
+#include <vector>
 
+// FNV-1a; constexpr so uniform names hash at compile time
+constexpr uint32_t HashName(std::string_view name) {
+  uint32_t hash = 2166136261u;
+  for (char c : name) {
+    hash = (hash ^ (uint8_t)c) * 16777619u;
+  }
+  return hash;
+}
+
+// Handle of a uniform of GLSL type T, for example
+//   static constexpr Uniform<glm::mat4> kUniformMVP{"uMVP"};
+// Setting it looks the name's hash up in the table Shader reflects at link
+// time, without strings or glGetUniformLocation.
+template <typename T> struct Uniform {
+  constexpr explicit Uniform(const char *name) : hash{HashName(name)} {};
+  uint32_t hash;
+};
+
+struct UniformBlock {
+  constexpr explicit UniformBlock(const char *name) : hash{HashName(name)} {};
+  uint32_t hash;
+};
+
+// A program built by a ShaderLibrary. It is linked and reflected on first
+// use, so creating one never waits for the driver, and reflected again
+// whenever the library swaps in a reloaded program.
 class Shader {
 public:
-  Shader(const char *vertex_path, const char *frag_path);
+  Shader(ShaderLibrary &library, const char *vertex_path,
+         const char *frag_path,
+         const std::vector<ShaderDefine> &defines = {});
+  Shader(ShaderLibrary &library, const char *compute_path,
+         const std::vector<ShaderDefine> &defines = {});
   ~Shader() {
-    if (m_program != 0) {
-      glDeleteProgram(m_program);
+    if (m_library != nullptr) {
+      m_library->DeleteProgram(m_handle);
     }
   };
   NEVER_COPY(Shader);
-  Shader(Shader &&other) : m_program{other.m_program} { other.m_program = 0; };
+  Shader(Shader &&other)
+      : m_library{other.m_library}, m_handle{other.m_handle},
+        m_program{other.m_program}, m_generation{other.m_generation},
+        m_uniforms{std::move(other.m_uniforms)},
+        m_blocks{std::move(other.m_blocks)} {
+    other.m_library = nullptr;
+  };
   inline void UseProgram() const;
-  inline void UniformBlockBinding(const std::string &block_name,
+  inline void UniformBlockBinding(const UniformBlock &block,
                                   GLuint block_binding) const;
-  inline void Uniform3fv(const std::string &name, const glm::vec3 &value) const;
-  inline void Uniform4fv(const std::string &name, const glm::vec4 &value) const;
-  inline void UniformMatrix4fv(const std::string &name, GLboolean transpose,
-                               const glm::mat4 &value) const;
-  inline void Uniform1f(const std::string &name, float value) const;
-  inline void Uniform1i(const std::string &name, GLint value) const;
-  inline void Uniform1ui(const std::string &name, GLuint value) const;
+  // Uniforms the program does not use are ignored, like location -1
+  inline void SetUniform(const Uniform<float> &uniform, float value) const;
+  inline void SetUniform(const Uniform<GLint> &uniform, GLint value) const;
+  inline void SetUniform(const Uniform<GLuint> &uniform, GLuint value) const;
+  inline void SetUniform(const Uniform<glm::vec3> &uniform,
+                         const glm::vec3 &value) const;
+  inline void SetUniform(const Uniform<glm::vec4> &uniform,
+                         const glm::vec4 &value) const;
+  inline void SetUniform(const Uniform<glm::vec4> &uniform,
+                         const glm::vec4 *values, GLsizei count) const;
+  inline void SetUniform(const Uniform<glm::mat4> &uniform,
+                         const glm::mat4 &value) const;
 
 private:
-  inline GLuint GetUniformLocation(const std::string &name) const;
-  inline GLuint GetUniformBlockIndex(const std::string &block_name) const;
-  GLuint m_program = 0;
+  // active uniform or uniform block, sorted by hash
+  struct Reflected {
+    uint32_t hash;
+    GLint location;
+  };
+  // Picks up the library's current program, reflecting it if it is new
+  inline void Link() const;
+  void Reflect() const;
+  inline GLint Find(const std::vector<Reflected> &table, uint32_t hash) const;
+  ShaderLibrary *m_library;
+  ProgramHandle m_handle;
+  // filled by Link
+  mutable GLuint m_program = 0;
+  mutable GLuint m_generation{0};
+  // uniform locations and uniform block indices
+  mutable std::vector<Reflected> m_uniforms{};
+  mutable std::vector<Reflected> m_blocks{};
 };
 
-inline void Shader::UseProgram() const { glUseProgram(m_program); };
+inline void Shader::Link() const {
+  m_program = m_library->GetProgram(m_handle);
+  GLuint generation = m_library->GetGeneration(m_handle);
+  if (generation != m_generation) {
+    m_generation = generation;
+    Reflect();
+  }
+};
 
-inline GLuint Shader::GetUniformLocation(const std::string &name) const {
-  return glGetUniformLocation(m_program, name.c_str());
+inline void Shader::UseProgram() const {
+  Link();
+  GetGLState().UseProgram(m_program);
 };
 
-inline GLuint
-Shader::GetUniformBlockIndex(const std::string &block_name) const {
-  return glGetUniformBlockIndex(m_program, block_name.c_str());
+inline GLint Shader::Find(const std::vector<Reflected> &table,
+                          uint32_t hash) const {
+  Link();
+  auto it = std::lower_bound(
+      table.begin(), table.end(), hash,
+      [](const Reflected &entry, uint32_t hash) { return entry.hash < hash; });
+  return it != table.end() && it->hash == hash ? it->location : -1;
 };
 
-inline void Shader::UniformBlockBinding(const std::string &block_name,
+inline void Shader::UniformBlockBinding(const UniformBlock &block,
                                         GLuint block_binding) const {
-  GLuint uniform_block_index = GetUniformBlockIndex(block_name);
-  return glUniformBlockBinding(m_program, uniform_block_index, block_binding);
+  GLint block_index = Find(m_blocks, block.hash);
+  if (block_index >= 0) {
+    glUniformBlockBinding(m_program, block_index, block_binding);
+  }
 };
 
-inline void Shader::Uniform3fv(const std::string &name,
-                               const glm::vec3 &value) const {
-
-  glProgramUniform3fv(m_program, GetUniformLocation(name), 1,
-                      glm::value_ptr(value));
+inline void Shader::SetUniform(const Uniform<float> &uniform,
+                               float value) const {
+  // Find links, which may change m_program, so it runs before m_program
+  // is read
+  GLint location = Find(m_uniforms, uniform.hash);
+  glProgramUniform1f(m_program, location, value);
 };
-inline void Shader::Uniform4fv(const std::string &name,
-                               const glm::vec4 &value) const {
-  glProgramUniform4fv(m_program, GetUniformLocation(name), 1,
-                      glm::value_ptr(value));
+inline void Shader::SetUniform(const Uniform<GLint> &uniform,
+                               GLint value) const {
+  GLint location = Find(m_uniforms, uniform.hash);
+  glProgramUniform1i(m_program, location, value);
 };
-inline void Shader::UniformMatrix4fv(const std::string &name,
-                                     GLboolean transpose,
-                                     const glm::mat4 &value) const {
-  glProgramUniformMatrix4fv(m_program, GetUniformLocation(name), 1, transpose,
-                            glm::value_ptr(value));
+inline void Shader::SetUniform(const Uniform<GLuint> &uniform,
+                               GLuint value) const {
+  GLint location = Find(m_uniforms, uniform.hash);
+  glProgramUniform1ui(m_program, location, value);
+};
+inline void Shader::SetUniform(const Uniform<glm::vec3> &uniform,
+                               const glm::vec3 &value) const {
+  GLint location = Find(m_uniforms, uniform.hash);
+  glProgramUniform3fv(m_program, location, 1, glm::value_ptr(value));
 };
-inline void Shader::Uniform1f(const std::string &name, float value) const {
-  glProgramUniform1f(m_program, GetUniformLocation(name), value);
+inline void Shader::SetUniform(const Uniform<glm::vec4> &uniform,
+                               const glm::vec4 &value) const {
+  GLint location = Find(m_uniforms, uniform.hash);
+  glProgramUniform4fv(m_program, location, 1, glm::value_ptr(value));
 };
-
-inline void Shader::Uniform1i(const std::string &name, GLint value) const {
-  glProgramUniform1i(m_program, GetUniformLocation(name), value);
+inline void Shader::SetUniform(const Uniform<glm::vec4> &uniform,
+                               const glm::vec4 *values, GLsizei count) const {
+  GLint location = Find(m_uniforms, uniform.hash);
+  glProgramUniform4fv(m_program, location, count, glm::value_ptr(values[0]));
 };
-inline void Shader::Uniform1ui(const std::string &name, GLuint value) const {
-  glProgramUniform1ui(m_program, GetUniformLocation(name), value);
+inline void Shader::SetUniform(const Uniform<glm::mat4> &uniform,
+                               const glm::mat4 &value) const {
+  GLint location = Find(m_uniforms, uniform.hash);
+  glProgramUniformMatrix4fv(m_program, location, 1, GL_FALSE,
+                            glm::value_ptr(value));
 };
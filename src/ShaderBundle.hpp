@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "gl.hpp"
+
+// A GLSL file with its includes expanded at build time
+struct EmbeddedShader {
+  std::string_view path;
+  // #line markers number files as in ShaderBundle::source_paths
+  std::string_view source;
+  // HashSource of source
+  uint64_t hash;
+  // every file the expansion read
+  const std::string_view *files;
+  GLuint num_files;
+};
+
+// Every file of shaders/, expanded by src/Tools/ShaderBundle.cpp when
+// building so the game reads no shader sources at startup
+struct ShaderBundle {
+  const EmbeddedShader *shaders;
+  GLuint num_shaders;
+  // path of every source string number the expansions used
+  const std::string_view *source_paths;
+  GLuint num_source_paths;
+};
+
+// generated into build/generated/ShaderBundle.cpp
+extern const ShaderBundle kShaderBundle;
@@ -0,0 +1,241 @@
+#include <SDL.h>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#include "ProgramCache.hpp"
+#include "ShaderLibrary.hpp"
+
+typedef void (*MaxShaderCompilerThreads)(GLuint count);
+
+// from GL_KHR_parallel_shader_compile
+static const GLenum kCompletionStatus = 0x91B1;
+
+static const char *GetStageName(GLenum type) {
+  switch (type) {
+  case GL_VERTEX_SHADER:
+    return "VERTEX";
+  case GL_FRAGMENT_SHADER:
+    return "FRAGMENT";
+  case GL_COMPUTE_SHADER:
+    return "COMPUTE";
+  }
+  return "UNKNOWN";
+}
+
+ShaderLibrary::ShaderLibrary()
+    : m_preprocessor{getenv("SHADERS_FROM_DISK") != nullptr ? nullptr
+                                                             : &kShaderBundle} {
+  const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+  if (extensions != nullptr &&
+      strstr(extensions, "GL_KHR_parallel_shader_compile")) {
+    m_has_completion_status = true;
+    MaxShaderCompilerThreads max_threads =
+        (MaxShaderCompilerThreads)SDL_GL_GetProcAddress(
+            "glMaxShaderCompilerThreadsKHR");
+    if (max_threads != nullptr) {
+      // as many as the driver likes
+      max_threads(0xffffffff);
+    }
+  }
+};
+
+ShaderLibrary::~ShaderLibrary() {
+  for (const auto &[hash, shader] : m_shaders) {
+    glDeleteShader(shader);
+  }
+};
+
+GLuint ShaderLibrary::CompileShader(GLenum type, const ShaderSource &source) {
+  uint64_t hash = HashSource(GetStageName(type), source.hash);
+  auto it = m_shaders.find(hash);
+  if (it != m_shaders.end()) {
+    return it->second;
+  }
+  const char *c_str = source.text.c_str();
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &c_str, nullptr);
+  glCompileShader(shader);
+  m_shaders.emplace(hash, shader);
+  return shader;
+};
+
+ShaderLibrary::Build ShaderLibrary::SubmitBuild(const Program &program) {
+  std::vector<ShaderSource> sources{};
+  std::vector<uint64_t> source_hashes{};
+  for (const ShaderStage &stage : program.stages) {
+    std::vector<std::string> files{};
+    sources.push_back(
+        m_preprocessor.Preprocess(stage.path, program.defines, &files));
+    source_hashes.push_back(sources.back().hash);
+    for (const std::string &file : files) {
+      // bundled shaders need no shaders/ next to the game
+      std::error_code ec;
+      if (std::filesystem::exists(file, ec)) {
+        m_watcher.Watch(file);
+      }
+    }
+  }
+  Build build{.program = glCreateProgram(),
+              .shaders = {},
+              .cache_key = GetProgramCacheKey(source_hashes)};
+  if (LoadProgramBinary(build.program, build.cache_key)) {
+    return build;
+  }
+  for (GLuint i = 0; i < program.stages.size(); i++) {
+    GLuint shader = CompileShader(program.stages[i].type, sources[i]);
+    glAttachShader(build.program, shader);
+    build.shaders.push_back(shader);
+  }
+  glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                      GL_TRUE);
+  glLinkProgram(build.program);
+  return build;
+};
+
+bool ShaderLibrary::IsBuildComplete(const Build &build) const {
+  // without the extension asking would block, so assume it is done
+  if (!m_has_completion_status) {
+    return true;
+  }
+  GLint is_complete = GL_TRUE;
+  glGetProgramiv(build.program, kCompletionStatus, &is_complete);
+  return is_complete == GL_TRUE;
+};
+
+std::string ShaderLibrary::CheckBuild(const Program &program,
+                                      const Build &build) {
+  const uint kLogBufferSize = 512;
+  int success;
+  char info_log[kLogBufferSize]{};
+  glGetProgramiv(build.program, GL_LINK_STATUS, &success);
+  if (!success) {
+    // a stage that did not compile explains the failed link best
+    for (GLuint i = 0; i < build.shaders.size(); i++) {
+      glGetShaderiv(build.shaders[i], GL_COMPILE_STATUS, &success);
+      if (!success) {
+        glGetShaderInfoLog(build.shaders[i], kLogBufferSize, NULL, info_log);
+        return std::string{"ERROR::SHADER::"} +
+               GetStageName(program.stages[i].type) +
+               "::COMPILATION_FAILED\n" + program.stages[i].path + "\n" +
+               m_preprocessor.AnnotateLog(info_log);
+      }
+    }
+    glGetProgramInfoLog(build.program, kLogBufferSize, NULL, info_log);
+    return "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" + program.name + "\n" +
+           m_preprocessor.AnnotateLog(info_log);
+  }
+  // a binary loaded from the cache has no shaders and nothing to save
+  if (!build.shaders.empty()) {
+    for (GLuint shader : build.shaders) {
+      glDetachShader(build.program, shader);
+    }
+    SaveProgramBinary(build.program, build.cache_key);
+  }
+  return "";
+};
+
+ProgramHandle
+ShaderLibrary::CreateProgram(const std::vector<ShaderStage> &stages,
+                             const std::vector<ShaderDefine> &defines) {
+  uint64_t variant_key = kSourceHashSeed;
+  Program program{.name = {},
+                  .stages = stages,
+                  .defines = defines,
+                  .refs = 1,
+                  .variant_key = 0,
+                  .program = 0,
+                  .generation = 0,
+                  .build = {},
+                  .reload = {}};
+  for (const ShaderStage &stage : stages) {
+    program.name += (program.name.empty() ? "" : ", ") + stage.path;
+    variant_key = HashSource(GetStageName(stage.type), variant_key);
+    variant_key = HashSource(stage.path, variant_key);
+  }
+  for (const ShaderDefine &define : defines) {
+    program.name += " " + define.name + "=" + define.value;
+    // the separator keeps {"A", "BC"} and {"AB", "C"} apart
+    variant_key = HashSource(define.name + "=" + define.value + "\n",
+                             variant_key);
+  }
+  program.variant_key = variant_key;
+  auto it = m_variants.find(variant_key);
+  if (it != m_variants.end()) {
+    m_programs[it->second].refs++;
+    return it->second;
+  }
+  program.build = SubmitBuild(program);
+  program.program = program.build.program;
+  m_programs.push_back(std::move(program));
+  m_variants.emplace(variant_key, m_programs.size() - 1);
+  return m_programs.size() - 1;
+};
+
+void ShaderLibrary::FinishProgram(Program &program) {
+  std::string error = CheckBuild(program, program.build);
+  if (!error.empty()) {
+    throw std::runtime_error(error);
+  }
+  program.generation = 1;
+  program.build = {};
+  std::cout << "Loaded shaders:" << program.name << std::endl;
+};
+
+void ShaderLibrary::DeleteProgram(ProgramHandle handle) {
+  Program &program = m_programs[handle];
+  if (--program.refs > 0) {
+    return;
+  }
+  m_variants.erase(program.variant_key);
+  glDeleteProgram(program.program);
+  glDeleteProgram(program.reload.program);
+  program.program = 0;
+  program.reload = {};
+};
+
+void ShaderLibrary::Update() {
+  std::vector<std::string> changed{m_watcher.Poll()};
+  for (const std::string &file : changed) {
+    m_preprocessor.Invalidate(file);
+  }
+  for (Program &program : m_programs) {
+    bool is_affected = false;
+    for (const std::string &file : changed) {
+      for (const ShaderStage &stage : program.stages) {
+        is_affected |= m_preprocessor.DependsOn(stage.path, file);
+      }
+    }
+    if (program.program == 0 || !is_affected) {
+      continue;
+    }
+    // a newer edit replaces a rebuild still in flight
+    glDeleteProgram(program.reload.program);
+    program.reload = {};
+    try {
+      program.reload = SubmitBuild(program);
+    } catch (const std::runtime_error &error) {
+      std::cerr << error.what() << std::endl;
+    }
+  }
+
+  for (Program &program : m_programs) {
+    if (program.reload.program == 0 || program.generation == 0 ||
+        !IsBuildComplete(program.reload)) {
+      continue;
+    }
+    std::string error = CheckBuild(program, program.reload);
+    if (!error.empty()) {
+      std::cerr << error << "Keeping the previous program." << std::endl;
+      glDeleteProgram(program.reload.program);
+    } else {
+      glDeleteProgram(program.program);
+      program.program = program.reload.program;
+      program.generation++;
+      std::cout << "Reloaded shaders:" << program.name << std::endl;
+    }
+    program.reload = {};
+  }
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "FileWatcher.hpp"
+#include "ShaderPreprocessor.hpp"
+#include "gl.hpp"
+#include "utils.hpp"
+
+struct ShaderStage {
+  GLenum type;
+  std::string path;
+};
+
+typedef GLuint ProgramHandle;
+
+// Builds programs without waiting on the driver. Identical stages share
+// one shader object, keyed by a hash of their source, and compiles and
+// links are only submitted; their status is first queried when a program
+// is used. Every program can so be in flight at once, compiled on the
+// driver's threads where GL_KHR_parallel_shader_compile allows.
+// Sources come from the bundle built with the game; setting
+// SHADERS_FROM_DISK reads shaders/ instead. Either way the files are
+// watched where they exist: Update rebuilds the programs that include a
+// changed file and swaps each in once it links, keeping the old one if it
+// does not. Programs are variants: the same stages built with different
+// ShaderDefine sets are separate programs, and asking for a variant that
+// exists again shares it. Must outlive every Shader it built.
+class ShaderLibrary {
+public:
+  ShaderLibrary();
+  ~ShaderLibrary();
+  NEVER_COPY(ShaderLibrary);
+  // From the program binary cache when possible, otherwise compiling.
+  // Every stage is built with defines.
+  ProgramHandle CreateProgram(const std::vector<ShaderStage> &stages,
+                              const std::vector<ShaderDefine> &defines = {});
+  // The current program of handle. Waits for the first link and throws
+  // with the driver's log if it failed.
+  inline GLuint GetProgram(ProgramHandle handle);
+  // Changes whenever GetProgram does
+  GLuint GetGeneration(ProgramHandle handle) const {
+    return m_programs[handle].generation;
+  };
+  // Once per CreateProgram that returned handle
+  void DeleteProgram(ProgramHandle handle);
+  // GL thread, once per frame
+  void Update();
+
+private:
+  // a program submitted to the driver but not checked yet
+  struct Build {
+    GLuint program;
+    std::vector<GLuint> shaders;
+    uint64_t cache_key;
+  };
+  struct Program {
+    std::string name;
+    std::vector<ShaderStage> stages;
+    std::vector<ShaderDefine> defines;
+    // CreateProgram calls sharing this variant
+    GLuint refs;
+    uint64_t variant_key;
+    // 0 once deleted
+    GLuint program;
+    // 0 until linked, then counts the swaps
+    GLuint generation;
+    Build build;
+    // a rebuild from changed sources, program 0 if none
+    Build reload;
+  };
+  GLuint CompileShader(GLenum type, const ShaderSource &source);
+  Build SubmitBuild(const Program &program);
+  // Empty if build linked, otherwise why not
+  std::string CheckBuild(const Program &program, const Build &build);
+  void FinishProgram(Program &program);
+  bool IsBuildComplete(const Build &build) const;
+  ShaderPreprocessor m_preprocessor;
+  FileWatcher m_watcher{};
+  bool m_has_completion_status{false};
+  // source hash -> shader object
+  std::unordered_map<uint64_t, GLuint> m_shaders{};
+  // stages and defines hash -> live program
+  std::unordered_map<uint64_t, ProgramHandle> m_variants{};
+  std::vector<Program> m_programs{};
+};
+
+inline GLuint ShaderLibrary::GetProgram(ProgramHandle handle) {
+  Program &program = m_programs[handle];
+  if (program.generation == 0) {
+    FinishProgram(program);
+  }
+  return program.program;
+};
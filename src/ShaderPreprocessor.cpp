@@ -0,0 +1,219 @@
+#include <filesystem>
+#include <regex>
+
+#include "ShaderPreprocessor.hpp"
+#include "utils.hpp"
+
+static std::string NormalizePath(const std::filesystem::path &path) {
+  return path.lexically_normal().string();
+}
+
+// The file of an #include "file" line, relative to the including file, or
+// an empty string for any other line
+static std::string ParseInclude(std::string_view line,
+                                const std::filesystem::path &directory) {
+  size_t start = line.find_first_not_of(" \t");
+  if (start == line.npos || line.compare(start, 8, "#include") != 0) {
+    return "";
+  }
+  size_t l_quote = line.find('"', start + 8);
+  size_t r_quote = line.find('"', l_quote + 1);
+  if (l_quote == line.npos || r_quote == line.npos) {
+    return "";
+  }
+  return NormalizePath(directory /
+                       line.substr(l_quote + 1, r_quote - l_quote - 1));
+}
+
+// Defines go right after #version, which has to stay first
+static void InsertDefines(const std::vector<ShaderDefine> &defines,
+                          ShaderSource &source) {
+  std::string lines{};
+  for (const ShaderDefine &define : defines) {
+    std::string line = "#define " + define.name + " " + define.value + "\n";
+    source.hash = HashSource(line, source.hash);
+    lines += line;
+  }
+  size_t position = 0;
+  if (source.text.compare(0, 8, "#version") == 0) {
+    position = source.text.find('\n');
+    position = position == source.text.npos ? source.text.size()
+                                             : position + 1;
+  }
+  source.text.insert(position, lines);
+}
+
+ShaderPreprocessor::ShaderPreprocessor(const ShaderBundle *bundle)
+    : m_bundle{bundle} {
+  // files read from disk later keep the numbers the bundle's #lines use
+  if (m_bundle != nullptr) {
+    for (GLuint i = 0; i < m_bundle->num_source_paths; i++) {
+      GetSourceId(std::string{m_bundle->source_paths[i]});
+    }
+  }
+}
+
+GLuint ShaderPreprocessor::GetSourceId(const std::string &path) {
+  auto it = m_source_ids.find(path);
+  if (it == m_source_ids.end()) {
+    it = m_source_ids.emplace(path, m_source_paths.size()).first;
+    m_source_paths.push_back(path);
+  }
+  return it->second;
+}
+
+const EmbeddedShader *
+ShaderPreprocessor::FindEmbedded(const std::string &root) const {
+  if (m_bundle == nullptr) {
+    return nullptr;
+  }
+  for (GLuint i = 0; i < m_bundle->num_shaders; i++) {
+    const EmbeddedShader &shader = m_bundle->shaders[i];
+    if (shader.path != root) {
+      continue;
+    }
+    for (GLuint j = 0; j < shader.num_files; j++) {
+      if (m_overridden.count(std::string{shader.files[j]})) {
+        return nullptr;
+      }
+    }
+    return &shader;
+  }
+  return nullptr;
+}
+
+const ShaderPreprocessor::ParsedFile &
+ShaderPreprocessor::Parse(const std::string &path) {
+  auto it = m_files.find(path);
+  if (it != m_files.end()) {
+    return it->second;
+  }
+  ParsedFile file{.source_id = GetSourceId(path), .segments = {}};
+  const std::string src = LoadFileIntoString(path);
+  const std::filesystem::path directory =
+      std::filesystem::path(path).parent_path();
+  Segment segment{};
+  GLuint line_number = 1;
+  for (size_t begin = 0; begin < src.size(); line_number++) {
+    size_t end = src.find('\n', begin);
+    end = end == src.npos ? src.size() : end + 1;
+    std::string_view line{src.data() + begin, end - begin};
+    std::string include = ParseInclude(line, directory);
+    if (include.empty()) {
+      segment.text.append(line);
+    } else {
+      segment.include = include;
+      segment.next_line = line_number + 1;
+      file.segments.push_back(std::move(segment));
+      segment = Segment{};
+    }
+    begin = end;
+  }
+  file.segments.push_back(std::move(segment));
+  return m_files.emplace(path, std::move(file)).first->second;
+}
+
+void ShaderPreprocessor::Expand(const std::string &path,
+                                std::unordered_set<std::string> &seen,
+                                std::string &out) {
+  if (!seen.insert(path).second) {
+    return;
+  }
+  // stays valid, m_files never moves its elements
+  const ParsedFile &file = Parse(path);
+  const std::string source = std::to_string(file.source_id);
+  for (const Segment &segment : file.segments) {
+    out += segment.text;
+    if (segment.include.empty()) {
+      continue;
+    }
+    if (!out.empty() && out.back() != '\n') {
+      out += '\n';
+    }
+    out += "#line 1 " +
+           std::to_string(Parse(segment.include).source_id) + "\n";
+    Expand(segment.include, seen, out);
+    if (!out.empty() && out.back() != '\n') {
+      out += '\n';
+    }
+    out += "#line " + std::to_string(segment.next_line) + " " + source + "\n";
+  }
+}
+
+ShaderSource
+ShaderPreprocessor::Preprocess(const std::string &path,
+                               const std::vector<ShaderDefine> &defines,
+                               std::vector<std::string> *files) {
+  const std::string root = NormalizePath(path);
+  ShaderSource source{};
+  std::unordered_set<std::string> seen{};
+  const EmbeddedShader *embedded = FindEmbedded(root);
+  if (embedded != nullptr) {
+    source = {.text = std::string{embedded->source},
+              .hash = embedded->hash};
+    for (GLuint i = 0; i < embedded->num_files; i++) {
+      seen.insert(std::string{embedded->files[i]});
+    }
+  } else {
+    const ParsedFile &file = Parse(root);
+    // #version has to stay first, so the root's number follows it
+    const std::string &text = file.segments[0].text;
+    size_t version_end = 0;
+    GLuint first_line = 1;
+    if (text.compare(0, 8, "#version") == 0) {
+      version_end = text.find('\n');
+      version_end = version_end == text.npos ? text.size() : version_end + 1;
+      source.text = text.substr(0, version_end);
+      first_line = 2;
+    }
+    source.text += "#line " + std::to_string(first_line) + " " +
+                   std::to_string(file.source_id) + "\n";
+    std::string body{};
+    Expand(root, seen, body);
+    source.text.append(body, version_end);
+    source.hash = HashSource(source.text);
+  }
+  InsertDefines(defines, source);
+
+  for (auto &[file_path, roots] : m_dependents) {
+    roots.erase(root);
+  }
+  for (const std::string &file_path : seen) {
+    m_dependents[file_path].insert(root);
+  }
+  if (files != nullptr) {
+    files->assign(seen.begin(), seen.end());
+  }
+  return source;
+}
+
+std::string ShaderPreprocessor::AnnotateLog(const std::string &log) const {
+  // "0:12" as in "ERROR: 0:12: ..." or "0:12(7): error: ..."
+  static const std::regex kReference{R"((^|\s)(\d+):(\d+))"};
+  std::string out{};
+  auto last = log.cbegin();
+  for (std::sregex_iterator it{log.begin(), log.end(), kReference}, end{};
+       it != end; ++it) {
+    const std::smatch &match = *it;
+    GLuint source_id = std::stoul(match[2].str());
+    out.append(last, match[0].first);
+    out += match[1].str();
+    out += source_id < m_source_paths.size() ? m_source_paths[source_id]
+                                             : match[2].str();
+    out += ":" + match[3].str();
+    last = match[0].second;
+  }
+  out.append(last, log.cend());
+  return out;
+}
+
+bool ShaderPreprocessor::DependsOn(const std::string &root,
+                                   const std::string &path) const {
+  auto it = m_dependents.find(NormalizePath(path));
+  return it != m_dependents.end() && it->second.count(NormalizePath(root));
+}
+
+void ShaderPreprocessor::Invalidate(const std::string &path) {
+  m_files.erase(NormalizePath(path));
+  m_overridden.insert(NormalizePath(path));
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ShaderBundle.hpp"
+#include "gl.hpp"
+
+// #define name value, prepended to a shader to select one of its variants
+struct ShaderDefine {
+  std::string name;
+  std::string value;
+};
+
+struct ShaderSource {
+  std::string text;
+  // identifies text, for deduplication and the program binary cache
+  uint64_t hash;
+};
+
+// Expands #include "file" directives in GLSL. Every file is read and split
+// at its includes once, then reused by every shader that includes it; each
+// file is pasted at most once per expanded shader. #line markers keep
+// compiler messages pointing at the original file and line, with files
+// numbered as source strings, see AnnotateLog. Expanding also records which
+// root shaders every file ended up in.
+// Defines are inserted right after #version, so shaders test them with
+// #if and give defaults with #ifndef; every set yields its own variant.
+// Shaders in bundle come expanded already and are only read from disk once
+// a file they include has been invalidated, which is how hot reload and
+// edits during development override them.
+class ShaderPreprocessor {
+public:
+  explicit ShaderPreprocessor(const ShaderBundle *bundle = nullptr);
+  // files, if given, receives every file the expansion read
+  ShaderSource Preprocess(const std::string &path,
+                          const std::vector<ShaderDefine> &defines = {},
+                          std::vector<std::string> *files = nullptr);
+  // Rewrites "<source string>:<line>" references in a driver log to
+  // "<file>:<line>"
+  std::string AnnotateLog(const std::string &log) const;
+  // Whether the last expansion of root read path
+  bool DependsOn(const std::string &root, const std::string &path) const;
+  // Forgets path's cached contents so the next expansion rereads it
+  void Invalidate(const std::string &path);
+  // File of every source string number handed out so far
+  const std::vector<std::string> &GetSourcePaths() const {
+    return m_source_paths;
+  };
+
+private:
+  // text up to an #include, then the included file; the last one of a
+  // file has no include
+  struct Segment {
+    std::string text;
+    std::string include;
+    // first line after the #include
+    GLuint next_line;
+  };
+  struct ParsedFile {
+    GLuint source_id;
+    std::vector<Segment> segments;
+  };
+  // root's bundled expansion, nullptr if it has none or is overridden
+  const EmbeddedShader *FindEmbedded(const std::string &root) const;
+  GLuint GetSourceId(const std::string &path);
+  const ParsedFile &Parse(const std::string &path);
+  void Expand(const std::string &path, std::unordered_set<std::string> &seen,
+              std::string &out);
+  const ShaderBundle *m_bundle;
+  // invalidated files, read from disk from then on
+  std::unordered_set<std::string> m_overridden{};
+  std::unordered_map<std::string, ParsedFile> m_files{};
+  // path of every source string number handed out
+  std::vector<std::string> m_source_paths{};
+  std::unordered_map<std::string, GLuint> m_source_ids{};
+  // file -> root shaders that included it
+  std::unordered_map<std::string, std::unordered_set<std::string>>
+      m_dependents{};
+};
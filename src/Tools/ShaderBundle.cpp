@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../ShaderPreprocessor.hpp"
+
+// Expands the includes of every GLSL file given and writes them as the
+// constexpr tables of kShaderBundle, see ShaderBundle.hpp.
+// Usage: shader_bundle out.cpp shaders/*.glsl
+
+static const char *kDelimiter = "glsl";
+
+struct Entry {
+  std::string path;
+  ShaderSource source;
+  std::vector<std::string> files;
+};
+
+static std::string Quote(const std::string &text) {
+  return "R\"" + std::string{kDelimiter} + "(" + text + ")" + kDelimiter +
+         "\"";
+}
+
+int main(int argc, char *args[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: shader_bundle out.cpp [file.glsl ...]" << std::endl;
+    return 1;
+  }
+  const std::string out_path = args[1];
+  const std::string terminator = ")" + std::string{kDelimiter} + "\"";
+  ShaderPreprocessor preprocessor{};
+  std::vector<Entry> entries{};
+  for (int i = 2; i < argc; i++) {
+    Entry entry{.path = std::filesystem::path(args[i]).lexically_normal(),
+                .source = {},
+                .files = {}};
+    try {
+      entry.source = preprocessor.Preprocess(entry.path, {}, &entry.files);
+    } catch (const std::runtime_error &error) {
+      std::cerr << error.what() << std::endl;
+      return 1;
+    }
+    if (entry.source.text.find(terminator) != std::string::npos) {
+      std::cerr << entry.path << " contains " << terminator << std::endl;
+      return 1;
+    }
+    // the same sources always generate the same file
+    std::sort(entry.files.begin(), entry.files.end());
+    entries.push_back(std::move(entry));
+  }
+
+  const std::string tmp_path = out_path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::trunc);
+    if (!out.is_open()) {
+      std::cerr << "Could not write: " << out_path << std::endl;
+      return 1;
+    }
+    out << "// Generated by src/Tools/ShaderBundle.cpp, do not edit\n"
+        << "#include \"ShaderBundle.hpp\"\n\n";
+    for (size_t i = 0; i < entries.size(); i++) {
+      out << "static constexpr std::string_view kFiles" << i << "[] = {\n";
+      for (const std::string &file : entries[i].files) {
+        out << "    \"" << file << "\",\n";
+      }
+      out << "};\n";
+    }
+    out << "\nstatic constexpr EmbeddedShader kShaders[] = {\n";
+    for (size_t i = 0; i < entries.size(); i++) {
+      const Entry &entry = entries[i];
+      char hash[32];
+      snprintf(hash, sizeof(hash), "0x%016llxull",
+               (unsigned long long)entry.source.hash);
+      out << "    {\"" << entry.path << "\",\n"
+          << Quote(entry.source.text) << ",\n"
+          << "     " << hash << ", kFiles" << i << ", "
+          << entry.files.size() << "},\n";
+    }
+    out << "};\n\nstatic constexpr std::string_view kSourcePaths[] = {\n";
+    for (const std::string &path : preprocessor.GetSourcePaths()) {
+      out << "    \"" << path << "\",\n";
+    }
+    out << "};\n\n"
+        << "extern const ShaderBundle kShaderBundle = {\n"
+        << "    kShaders, " << entries.size() << ", kSourcePaths, "
+        << preprocessor.GetSourcePaths().size() << "};\n";
+    if (!out.good()) {
+      std::cerr << "Could not write: " << out_path << std::endl;
+      return 1;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, out_path, ec);
+  if (ec) {
+    std::cerr << "Could not write: " << out_path << std::endl;
+    return 1;
+  }
+  std::cout << "Bundled " << entries.size() << " shaders into " << out_path
+            << std::endl;
+  return 0;
+}
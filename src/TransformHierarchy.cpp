@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include "TransformHierarchy.hpp"
+
+TransformHierarchy::TransformHierarchy(const MeshNode *nodes,
+                                       GLuint num_nodes)
+    : m_parents(num_nodes), m_subtree_ends(num_nodes),
+      m_local_matrices(num_nodes), m_world_matrices(num_nodes),
+      m_dirty(num_nodes, false) {
+  for (GLuint i = 0; i < num_nodes; i++) {
+    m_parents[i] = nodes[i].parent;
+    m_local_matrices[i] = nodes[i].transform;
+    m_subtree_ends[i] = i + 1;
+  }
+  // children come after their parent, so walking backwards finishes every
+  // subtree before its parent reads the end
+  for (GLuint i = num_nodes; i-- > 0;) {
+    if (m_parents[i] >= 0) {
+      GLuint &parent_end = m_subtree_ends[m_parents[i]];
+      parent_end = std::max(parent_end, m_subtree_ends[i]);
+    }
+  }
+  for (GLuint i = 0; i < num_nodes; i++) {
+    if (m_parents[i] < 0) {
+      m_dirty[i] = true;
+      m_dirty_nodes.push_back(i);
+    }
+  }
+  Update();
+};
+
+GLuint TransformHierarchy::GetNumNodes() const { return m_parents.size(); };
+
+const glm::mat4 &TransformHierarchy::GetLocalMatrix(GLuint node) const {
+  return m_local_matrices[node];
+};
+
+void TransformHierarchy::SetLocalMatrix(GLuint node,
+                                        const glm::mat4 &transform) {
+  m_local_matrices[node] = transform;
+  if (!m_dirty[node]) {
+    m_dirty[node] = true;
+    m_dirty_nodes.push_back(node);
+  }
+};
+
+GLuint TransformHierarchy::Update() {
+  // in depth-first order a dirty node inside an already recomputed subtree
+  // needs no work of its own
+  std::sort(m_dirty_nodes.begin(), m_dirty_nodes.end());
+  GLuint num_updated = 0;
+  GLuint updated_end = 0;
+  for (GLuint node : m_dirty_nodes) {
+    m_dirty[node] = false;
+    if (node < updated_end) {
+      continue;
+    }
+    updated_end = m_subtree_ends[node];
+    for (GLuint i = node; i < updated_end; i++) {
+      GLint parent = m_parents[i];
+      m_world_matrices[i] =
+          parent < 0 ? m_local_matrices[i]
+                     : m_world_matrices[parent] * m_local_matrices[i];
+    }
+    num_updated += updated_end - node;
+  }
+  m_dirty_nodes.clear();
+  return num_updated;
+};
+
+const std::vector<glm::mat4> &TransformHierarchy::GetWorldMatrices() const {
+  return m_world_matrices;
+};
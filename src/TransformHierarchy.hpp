@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "MeshGroup.hpp"
+#include "gl.hpp"
+
+// Node transforms of a scene as flat arrays in depth-first order. Parents
+// precede their children and every subtree is a contiguous range, so
+// recomputing a changed subtree is one linear pass over its nodes and
+// untouched subtrees are never visited.
+class TransformHierarchy {
+public:
+  TransformHierarchy(const MeshNode *nodes, GLuint num_nodes);
+  GLuint GetNumNodes() const;
+  const glm::mat4 &GetLocalMatrix(GLuint node) const;
+  void SetLocalMatrix(GLuint node, const glm::mat4 &transform);
+  // Recomputes the world matrices of every subtree changed since the last
+  // call. Returns the number of nodes recomputed.
+  GLuint Update();
+  // World matrix of every node, valid after Update()
+  const std::vector<glm::mat4> &GetWorldMatrices() const;
+
+private:
+  std::vector<GLint> m_parents{};
+  // node i's subtree is [i, m_subtree_ends[i])
+  std::vector<GLuint> m_subtree_ends{};
+  std::vector<glm::mat4> m_local_matrices{};
+  std::vector<glm::mat4> m_world_matrices{};
+  std::vector<bool> m_dirty{};
+  std::vector<GLuint> m_dirty_nodes{};
+};
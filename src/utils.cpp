@@ -1,9 +1,12 @@
 #include "utils.hpp"
 
+#include <atomic>
 #include <fstream>
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 std::string LoadFileIntoString(const std::string &file_path) {
   std::ifstream file_stream(file_path);
@@ -15,128 +18,32 @@ std::string LoadFileIntoString(const std::string &file_path) {
   return buffer.str();
 }
 
-void PrintMaterial(const aiMaterial *material) {
-  printf("Material %s\n", material->GetName().C_Str());
-  for (uint j = 0; j < material->mNumProperties; j++) {
-    aiMaterialProperty *prop = material->mProperties[j];
-    aiPropertyTypeInfo prop_type = prop->mType;
-
-    const char *p_key = prop->mKey.C_Str();
-    printf("%s ", p_key);
-    switch (prop_type) {
-    case aiPTI_Float: {
-      float *float_out = (float *)prop->mData;
-      uint size = prop->mDataLength / sizeof(float);
-      for (uint k = 0; k < size; k++) {
-        printf("%.2f", float_out[k]);
-        if (k != size - 1) {
-          printf(", ");
-        }
-      }
-      break;
-    };
-    case aiPTI_Double: {
-      double *double_out = (double *)prop->mData;
-      uint size = prop->mDataLength / sizeof(double);
-      for (uint k = 0; k < size; k++) {
-        printf("%.2f", double_out[k]);
-        if (k != size - 1) {
-          printf(", ");
-        }
-      }
-      break;
-    }
-    case aiPTI_String: {
-      aiString string_out;
-      material->Get(p_key, prop_type, 0, string_out);
-      printf("%s", string_out.C_Str());
-      break;
-    }
-    case aiPTI_Integer: {
-      int *integer_out = (int *)prop->mData;
-      uint size = prop->mDataLength / sizeof(int);
-      for (uint k = 0; k < size; k++) {
-        printf("%i", integer_out[k]);
-        if (k != size - 1) {
-          printf(", ");
-        }
-      }
-      break;
+void ParallelFor(uint count, const std::function<void(uint)> &func) {
+  uint num_threads =
+      std::min(count, std::max(1u, std::thread::hardware_concurrency()));
+  std::atomic<uint> next{0};
+  auto Worker = [&]() {
+    for (uint i = next++; i < count; i = next++) {
+      func(i);
     }
-    case aiPTI_Buffer:
-    case _aiPTI_Force32Bit:
-      // no printable representation
-      break;
-    }
-    printf("\n");
+  };
+  std::vector<std::thread> threads{};
+  for (uint i = 1; i < num_threads; i++) {
+    threads.emplace_back(Worker);
   }
-}
-
-void PrintVertices(const aiMesh *mesh) {
-  for (uint j = 0; j < mesh->mNumVertices; j++) {
-    aiVector3D vertex = mesh->mVertices[j];
-    printf("v %.2f,%.2f,%.2f\n", vertex.x, vertex.y, vertex.z);
+  Worker();
+  for (std::thread &thread : threads) {
+    thread.join();
   }
 }
 
-void PrintNormals(const aiMesh *mesh) {
-  if (mesh->mNormals) {
-    for (uint j = 0; j < mesh->mNumVertices; j++) {
-      aiVector3D vertex = mesh->mNormals[j];
-      printf("vn %.2f,%.2f,%.2f\n", vertex.x, vertex.y, vertex.z);
-    }
+uint64_t HashSource(std::string_view source, uint64_t hash) {
+  for (char c : source) {
+    hash = (hash ^ (uint8_t)c) * 1099511628211ull;
   }
+  return hash;
 }
 
-void PrintTexCoords(const aiMesh *mesh) {
-  for (uint j = 0; j < AI_MAX_NUMBER_OF_TEXTURECOORDS; j++) {
-    if (!mesh->mTextureCoords[j])
-      continue;
-    const aiString *tex_coords_name = mesh->GetTextureCoordsName(j);
-    if (tex_coords_name) {
-      printf("tex_coords %s\n", tex_coords_name->C_Str());
-    } else {
-      printf("unnamed tex_coords\n");
-    }
-    for (uint k = 0; k < mesh->mNumVertices; k++) {
-      aiVector3D tex_coords = mesh->mTextureCoords[j][k];
-      printf("vt %.2f,%.2f,%.2f\n", tex_coords.x, tex_coords.y, tex_coords.z);
-    }
-  }
-}
-
-void PrintFaces(const aiMesh *mesh) {
-  for (uint j = 0; j < mesh->mNumFaces; j++) {
-    aiFace face = mesh->mFaces[j];
-    printf("f ");
-    for (uint k = 0; k < face.mNumIndices; k++) {
-      printf("%u", face.mIndices[k]);
-      if (k != face.mNumIndices - 1) {
-        printf("/");
-      } else {
-        printf("\n");
-      }
-    }
-  }
-}
-
-void PrintNode(aiNode *node, const aiScene *scene) {
-  printf("##Node##\n");
-  printf("%u meshes.\n", node->mNumMeshes);
-  printf("%u children.\n", node->mNumChildren);
-  for (uint i = 0; i < node->mNumMeshes; i++) {
-    printf("Mesh#%u\n", i);
-    aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-    PrintMaterial(scene->mMaterials[mesh->mMaterialIndex]);
-    PrintVertices(mesh);
-    PrintNormals(mesh);
-    PrintTexCoords(mesh);
-    PrintFaces(mesh);
-  }
-  for (uint i = 0; i < node->mNumChildren; i++) {
-    PrintNode(node->mChildren[i], scene);
-  }
-}
 void PrintMatrix(const glm::mat4 &m) {
   for (uint col = 0; col < 4; col++) {
     printf("%.2f, ", m[0][col]);
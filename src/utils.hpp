@@ -1,20 +1,23 @@
 #pragma once
 
-#include <assimp/scene.h>
+#include <cstdint>
+#include <functional>
 #include <glm/glm.hpp>
 #include <string>
+#include <string_view>
 
 #define NEVER_COPY(T)                                                          \
   T(const T &) = delete;                                                       \
   T &operator=(const T &) = delete;
 
 std::string LoadFileIntoString(const std::string &file_path);
-void PrintMaterial(const aiMaterial *material);
-void PrintVertices(const aiMesh *mesh);
-void PrintNormals(const aiMesh *mesh);
-void PrintTexCoords(const aiMesh *mesh);
-void PrintFaces(const aiMesh *mesh);
-void PrintNode(aiNode *node, const aiScene *scene);
+// Runs func(0..count-1) on all hardware threads, handing out indices one at a
+// time so unevenly sized items still balance. Returns once every call is done.
+void ParallelFor(uint count, const std::function<void(uint)> &func);
+const uint64_t kSourceHashSeed = 14695981039346656037ull;
+
+// 64-bit FNV-1a; pass the previous result as hash to chain several strings
+uint64_t HashSource(std::string_view source, uint64_t hash = kSourceHashSeed);
 void PrintMatrix(const glm::mat4 &m);
 glm::vec3 GetCameraPos(const glm::mat4 &view_matrix);
 void ZoomCamera(glm::mat4 &view_matrix, glm::vec3 &target, float amount);